@@ -0,0 +1,144 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (C) 2025 Lese
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "BitPack.h"
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+void packBitsScalar(const uint8_t* src, int n, uint8_t* dst, bool invert) {
+  uint8_t flip = invert ? 0xFF : 0x00;
+  int i = 0;
+  for (; i + 8 <= n; i += 8, src += 8) {
+    uint8_t b = (src[0] & 0x80)      | (src[1] & 0x80) >> 1 |
+                (src[2] & 0x80) >> 2 | (src[3] & 0x80) >> 3 |
+                (src[4] & 0x80) >> 4 | (src[5] & 0x80) >> 5 |
+                (src[6] & 0x80) >> 6 | (src[7] & 0x80) >> 7;
+    *dst++ = b ^ flip;
+  }
+  if (i < n) {
+    uint8_t b = 0;
+    for (int k = 0; i + k < n; k++) b |= (src[k] & 0x80) >> k;
+    *dst = b ^ flip;
+  }
+}
+
+void unpackBitsScalar(const uint8_t* src, int n, uint8_t* dst, bool invert) {
+  uint8_t flip = invert ? 0xFF : 0x00;
+  for (int i = 0; i < n; i++) {
+    dst[i] = ((src[i / 8] & (0x80 >> (i % 8))) ? 0xFF : 0x00) ^ flip;
+  }
+}
+
+#if defined(__ARM_NEON)
+
+static const uint8_t bit_weights[16] = { 0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01,
+                                         0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01 };
+
+void packBits(const uint8_t* src, int n, uint8_t* dst, bool invert) {
+  uint8_t flip = invert ? 0xFF : 0x00;
+  uint8x16_t weights = vld1q_u8(bit_weights);
+  uint8x16_t top = vdupq_n_u8(0x80);
+  int i = 0;
+  for (; i + 16 <= n; i += 16) {
+    // Set lanes keep their bit weight, three pairwise adds sum each half
+    uint8x16_t bits = vandq_u8(vtstq_u8(vld1q_u8(src + i), top), weights);
+    uint8x8_t p = vpadd_u8(vget_low_u8(bits), vget_high_u8(bits));
+    p = vpadd_u8(p, p);
+    p = vpadd_u8(p, p);
+    dst[i / 8]     = vget_lane_u8(p, 0) ^ flip;
+    dst[i / 8 + 1] = vget_lane_u8(p, 1) ^ flip;
+  }
+  if (i < n) packBitsScalar(src + i, n - i, dst + i / 8, invert);
+}
+
+void unpackBits(const uint8_t* src, int n, uint8_t* dst, bool invert) {
+  uint8x16_t weights = vld1q_u8(bit_weights);
+  uint8x16_t flip = vdupq_n_u8(invert ? 0xFF : 0x00);
+  int i = 0;
+  for (; i + 16 <= n; i += 16) {
+    // Each byte fans out to 8 lanes, each lane tests its own bit
+    uint8x16_t b = vcombine_u8(vdup_n_u8(src[i / 8]), vdup_n_u8(src[i / 8 + 1]));
+    uint8x16_t set = vtstq_u8(b, weights);
+    vst1q_u8(dst + i, veorq_u8(set, flip));
+  }
+  if (i < n) unpackBitsScalar(src + i / 8, n - i, dst + i, invert);
+}
+
+const char* bitPackImpl(void) { return "NEON"; }
+
+#elif defined(__SSE2__)
+
+// Reverses the bytes within each 64-bit half, so that movemask puts the
+// first pixel of every 8 into the top bit of its byte
+static inline __m128i reverse_halves(__m128i v) {
+  v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+  v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(0, 1, 2, 3));
+  return _mm_shufflehi_epi16(v, _MM_SHUFFLE(0, 1, 2, 3));
+}
+
+void packBits(const uint8_t* src, int n, uint8_t* dst, bool invert) {
+  int flip = invert ? 0xFFFF : 0x0000;
+  int i = 0;
+  for (; i + 16 <= n; i += 16) {
+    int bits = _mm_movemask_epi8(reverse_halves(_mm_loadu_si128((const __m128i*)(src + i)))) ^ flip;
+    dst[i / 8]     = bits & 0xFF;
+    dst[i / 8 + 1] = bits >> 8;
+  }
+  if (i < n) packBitsScalar(src + i, n - i, dst + i / 8, invert);
+}
+
+void unpackBits(const uint8_t* src, int n, uint8_t* dst, bool invert) {
+  const __m128i weights = _mm_setr_epi8((char)0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01,
+                                        (char)0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01);
+  __m128i flip = _mm_set1_epi8(invert ? (char)0xFF : 0x00);
+  int i = 0;
+  for (; i + 16 <= n; i += 16) {
+    // Fan the two bytes out to 8 lanes each, then test each lane's bit
+    __m128i b = _mm_cvtsi32_si128(src[i / 8] | (src[i / 8 + 1] << 8));
+    b = _mm_unpacklo_epi8(b, b);
+    b = _mm_unpacklo_epi16(b, b);
+    b = _mm_unpacklo_epi32(b, b);
+    __m128i set = _mm_cmpeq_epi8(_mm_and_si128(b, weights), weights);
+    _mm_storeu_si128((__m128i*)(dst + i), _mm_xor_si128(set, flip));
+  }
+  if (i < n) unpackBitsScalar(src + i / 8, n - i, dst + i, invert);
+}
+
+const char* bitPackImpl(void) { return "SSE2"; }
+
+#else
+
+void packBits(const uint8_t* src, int n, uint8_t* dst, bool invert) {
+  packBitsScalar(src, n, dst, invert);
+}
+
+void unpackBits(const uint8_t* src, int n, uint8_t* dst, bool invert) {
+  unpackBitsScalar(src, n, dst, invert);
+}
+
+const char* bitPackImpl(void) { return "scalar"; }
+
+#endif
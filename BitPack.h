@@ -0,0 +1,44 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (C) 2025 Lese
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _BITPACK_H
+#define _BITPACK_H
+
+#include <cstdint>
+
+// Conversions between 8bpp masks and the 1bpp RAM format: 8 pixels per
+// byte, leftmost pixel in the MSB (bit 7 - x % 8, like drawPixel()).
+// A mask byte counts as set when its top bit is, so 0xFF/0x00 compare
+// results and thresholded gray both work. invert flips every bit, e.g.
+// to pack a "black" mask into the BW plane where 1 = white. A partial
+// last byte is padded with (inverted) zeros.
+void packBits(const uint8_t* src, int n, uint8_t* dst, bool invert = false);
+// Expands n bits back to 0x00/0xFF bytes
+void unpackBits(const uint8_t* src, int n, uint8_t* dst, bool invert = false);
+
+// Portable versions, always built. packBits()/unpackBits() use NEON or
+// SSE2 when the compiler targets them.
+void packBitsScalar(const uint8_t* src, int n, uint8_t* dst, bool invert = false);
+void unpackBitsScalar(const uint8_t* src, int n, uint8_t* dst, bool invert = false);
+const char* bitPackImpl(void); // "NEON", "SSE2" or "scalar"
+
+#endif
@@ -0,0 +1,380 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (C) 2025 Lese
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include "Dither.h"
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Classic recursive Bayer index matrix. The top left n x n corner divided
+// by (8 / n)^2 is the n x n matrix.
+static const uint8_t bayer8[8][8] = {
+  {  0, 32,  8, 40,  2, 34, 10, 42 },
+  { 48, 16, 56, 24, 50, 18, 58, 26 },
+  { 12, 44,  4, 36, 14, 46,  6, 38 },
+  { 60, 28, 52, 20, 62, 30, 54, 22 },
+  {  3, 35, 11, 43,  1, 33,  9, 41 },
+  { 51, 19, 59, 27, 49, 17, 57, 25 },
+  { 15, 47,  7, 39, 13, 45,  5, 37 },
+  { 63, 31, 55, 23, 61, 29, 53, 21 },
+};
+
+#if !defined(__ARM_NEON) && defined(__SSE2__)
+static inline uint8_t reverse_bits(uint8_t b) {
+  b = (b & 0xF0) >> 4 | (b & 0x0F) << 4;
+  b = (b & 0xCC) >> 2 | (b & 0x33) << 2;
+  b = (b & 0xAA) >> 1 | (b & 0x55) << 1;
+  return b;
+}
+#endif
+
+// One row of ordered dithering: white where gray > thr16[x % 16]. Any
+// matrix of size 2, 4 or 8 tiles a 16 byte vector exactly, so the same
+// threshold vector is reused for the whole row. Without simd the scalar
+// tail does the whole row, as the reference for the vector paths.
+static void ordered_row(const uint8_t* src, int w, const uint8_t* thr16, uint8_t* dst, bool simd) {
+  int x = 0;
+
+#if defined(__ARM_NEON)
+  if (simd) {
+  static const uint8_t weights[16] = { 0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01,
+                                       0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01 };
+  uint8x16_t t = vld1q_u8(thr16);
+  uint8x16_t wv = vld1q_u8(weights);
+  for (; x + 16 <= w; x += 16) {
+    // 0xFF lanes keep their bit weight, three pairwise adds sum each half
+    uint8x16_t white = vandq_u8(vcgtq_u8(vld1q_u8(src + x), t), wv);
+    uint8x8_t p = vpadd_u8(vget_low_u8(white), vget_high_u8(white));
+    p = vpadd_u8(p, p);
+    p = vpadd_u8(p, p);
+    dst[x / 8]     = vget_lane_u8(p, 0);
+    dst[x / 8 + 1] = vget_lane_u8(p, 1);
+  }
+  }
+#elif defined(__SSE2__)
+  if (simd) {
+  __m128i t = _mm_loadu_si128((const __m128i*)thr16);
+  for (; x + 16 <= w; x += 16) {
+    // SSE2 has no unsigned compare, gray <= t is min(gray, t) == gray
+    __m128i g = _mm_loadu_si128((const __m128i*)(src + x));
+    __m128i dark = _mm_cmpeq_epi8(_mm_min_epu8(g, t), g);
+    int white = ~_mm_movemask_epi8(dark); // Bit 0 is the leftmost pixel
+    dst[x / 8]     = reverse_bits(white & 0xFF);
+    dst[x / 8 + 1] = reverse_bits((white >> 8) & 0xFF);
+  }
+  }
+#else
+  (void)simd;
+#endif
+
+  for (; x < w; x += 8) {
+    uint8_t b = 0;
+    for (int i = 0; i < 8 && x + i < w; i++) {
+      if (src[x + i] > thr16[(x + i) & 15]) b |= 0x80 >> i;
+    }
+    dst[x / 8] = b;
+  }
+}
+
+static void dither_ordered(const uint8_t* gray, int w, int h, int gray_stride, uint8_t* out,
+                           int n, uint8_t threshold, bool simd) {
+  int out_stride = (w + 7) / 8;
+  uint8_t thr16[8][16];
+
+  // Threshold of index m is the middle of its 1/n^2 slice of 0..255,
+  // n == 1 is a plain threshold
+  int scale = (8 / n) * (8 / n);
+  for (int j = 0; j < n; j++) {
+    for (int i = 0; i < 16; i++) {
+      int m = bayer8[j][i % n] / scale;
+      thr16[j][i] = (n == 1) ? threshold : (2 * m + 1) * 128 / (n * n);
+    }
+  }
+
+  for (int y = 0; y < h; y++) {
+    ordered_row(gray + (size_t)y * gray_stride, w, thr16[y % n], out + (size_t)y * out_stride, simd);
+  }
+}
+
+// One Floyd-Steinberg row in direction dir. The error to the next pixel
+// and the two pending entries of the row below are carried in registers,
+// so every entry of next is written exactly once and needs no clearing.
+template <int dir>
+static inline void fs_row(const uint8_t* src, int w, const int16_t* cur, int16_t* next,
+                          uint8_t* dst, int threshold) {
+  int x = (dir > 0) ? 0 : w - 1;
+  int right = 0;   // Error pushed along the row
+  int below0 = 0;  // Pending for next[x - dir]
+  int below1 = 0;  // Pending for next[x]
+
+  for (int i = 0; i < w; i++, x += dir) {
+    int v = src[x] + cur[x] + right;
+    int white = v > threshold;
+    int e = v - (white ? 255 : 0);
+    dst[x / 8] |= white << (7 - x % 8);
+
+    int e7 = (e * 7) >> 4, e5 = (e * 5) >> 4, e3 = (e * 3) >> 4;
+    right = e7;
+    next[x - dir] = below0 + e3;
+    below0 = below1 + e5;
+    below1 = e - e7 - e5 - e3;
+  }
+  next[x - dir] = below0;
+}
+
+// Floyd-Steinberg with serpentine scanning. Only two rows of error are
+// live at a time (this row and the next), each padded by one entry on
+// both sides so the kernel never needs edge checks.
+static bool dither_floyd_steinberg(const uint8_t* gray, int w, int h, int gray_stride, uint8_t* out,
+                                   uint8_t threshold) {
+  int out_stride = (w + 7) / 8;
+  int16_t* err = (int16_t*)calloc(2 * (w + 2), sizeof(int16_t));
+  if (!err) return false;
+
+  int16_t* cur = err + 1;
+  int16_t* next = err + (w + 2) + 1;
+
+  for (int y = 0; y < h; y++) {
+    const uint8_t* src = gray + (size_t)y * gray_stride;
+    uint8_t* dst = out + (size_t)y * out_stride;
+    memset(dst, 0, out_stride);
+
+    // Odd rows run right to left so the error doesn't drift one way
+    if (y & 1) fs_row<-1>(src, w, cur, next, dst, threshold);
+    else       fs_row<1>(src, w, cur, next, dst, threshold);
+
+    int16_t* t = cur;
+    cur = next;
+    next = t;
+  }
+
+  free(err);
+  return true;
+}
+
+// Atkinson spreads 6/8 of the error over two rows below, so three rows of
+// error are live, padded by one entry on the left and two on the right.
+// The two in-row neighbours are carried in registers.
+static bool dither_atkinson(const uint8_t* gray, int w, int h, int gray_stride, uint8_t* out,
+                            uint8_t threshold) {
+  int out_stride = (w + 7) / 8;
+  int row_len = w + 3;
+  int16_t* err = (int16_t*)calloc(3 * row_len, sizeof(int16_t));
+  if (!err) return false;
+
+  int16_t* rows[3] = { err + 1, err + row_len + 1, err + 2 * row_len + 1 };
+
+  for (int y = 0; y < h; y++) {
+    const uint8_t* src = gray + (size_t)y * gray_stride;
+    uint8_t* dst = out + (size_t)y * out_stride;
+    const int16_t* r0 = rows[y % 3];
+    int16_t* r1 = rows[(y + 1) % 3];
+    int16_t* r2 = rows[(y + 2) % 3];
+    memset(dst, 0, out_stride);
+    memset(r2 - 1, 0, row_len * sizeof(int16_t));
+
+    int right1 = 0, right2 = 0; // Pending for x and x + 1
+    for (int x = 0; x < w; x++) {
+      int v = src[x] + r0[x] + right1;
+      int white = v > threshold;
+      int e = (v - (white ? 255 : 0)) / 8;
+      dst[x / 8] |= white << (7 - x % 8);
+
+      right1 = right2 + e;
+      right2 = e;
+      r1[x - 1] += e;
+      r1[x]     += e;
+      r1[x + 1] += e;
+      r2[x]      = e;
+    }
+  }
+
+  free(err);
+  return true;
+}
+
+// Tri-colour quantisation works on Y = luma, Cb = B - Y, Cr = R - Y. Red
+// and black differ mostly in Cr and white and red mostly in Y, which a
+// plain RGB distance gets wrong for dark reds and pinks.
+#define TRI_WHITE 0
+#define TRI_BLACK 1
+#define TRI_RED   2
+
+static const int16_t tri_palette[3][3] = {
+  { 255,   0,   0 }, // White
+  {   0,   0,   0 }, // Black
+  {  77, -77, 178 }, // Panel red, RGB 255 0 0
+};
+
+static inline void to_ycc(const uint8_t* p, int* c) {
+  c[0] = (77 * p[0] + 150 * p[1] + 29 * p[2]) >> 8;
+  c[1] = p[2] - c[0];
+  c[2] = p[0] - c[0];
+}
+
+// Weighted distance 3 dY^2 + dCb^2 + 2 dCr^2 to palette entry i, minus the
+// terms every entry shares. That leaves one linear form per entry, black
+// scores 0.
+static inline int tri_score(int i, const int* c) {
+  const int16_t* p = tri_palette[i];
+  return 3 * p[0] * p[0] + p[1] * p[1] + 2 * p[2] * p[2] -
+         2 * (3 * p[0] * c[0] + p[1] * c[1] + 2 * p[2] * c[2]);
+}
+
+static inline int nearest_tricolor(const int* c) {
+  int white = tri_score(TRI_WHITE, c);
+  int red = tri_score(TRI_RED, c);
+  if (white <= red) return (white <= 0) ? TRI_WHITE : TRI_BLACK;
+  return (red < 0) ? TRI_RED : TRI_BLACK;
+}
+
+static inline void put_tricolor(uint8_t* bw, uint8_t* red, int x, int color) {
+  uint8_t bit = 0x80 >> (x % 8);
+  if (color != TRI_BLACK) bw[x / 8] |= bit;
+  if (color == TRI_RED) red[x / 8] |= bit;
+}
+
+// Floyd-Steinberg over the three channels, same register pipelining as
+// fs_row(). Values are clamped so a run of out of gamut colours can't
+// push the error far beyond the palette.
+template <int dir>
+static inline void tri_row(const uint8_t* src, int w, int bpp, const int16_t* cur, int16_t* next,
+                           uint8_t* bw, uint8_t* red) {
+  int x = (dir > 0) ? 0 : w - 1;
+  int right[3] = { 0, 0, 0 }, below0[3] = { 0, 0, 0 }, below1[3] = { 0, 0, 0 };
+
+  for (int i = 0; i < w; i++, x += dir) {
+    int c[3];
+    to_ycc(src + x * bpp, c);
+    for (int k = 0; k < 3; k++) {
+      c[k] += cur[x * 3 + k] + right[k];
+      if (c[k] < -192) c[k] = -192;
+      if (c[k] > 448) c[k] = 448;
+    }
+
+    int color = nearest_tricolor(c);
+    put_tricolor(bw, red, x, color);
+
+    for (int k = 0; k < 3; k++) {
+      int e = c[k] - tri_palette[color][k];
+      int e7 = (e * 7) >> 4, e5 = (e * 5) >> 4, e3 = (e * 3) >> 4;
+      right[k] = e7;
+      next[(x - dir) * 3 + k] = below0[k] + e3;
+      below0[k] = below1[k] + e5;
+      below1[k] = e - e7 - e5 - e3;
+    }
+  }
+  for (int k = 0; k < 3; k++) next[(x - dir) * 3 + k] = below0[k];
+}
+
+bool ditherTricolor(const uint8_t* rgb, int w, int h, int rgb_stride, int bytes_per_pixel,
+                    uint8_t* out_bw, uint8_t* out_red, bool diffuse) {
+  if (!rgb || !out_bw || !out_red || w <= 0 || h <= 0 || bytes_per_pixel < 3) return false;
+
+  int out_stride = (w + 7) / 8;
+  int16_t* err = NULL;
+  int16_t* cur = NULL;
+  int16_t* next = NULL;
+  if (diffuse) {
+    // Two rows of three channels, one pixel of padding on each side
+    err = (int16_t*)calloc(2 * 3 * (w + 2), sizeof(int16_t));
+    if (!err) return false;
+    cur = err + 3;
+    next = err + 3 * (w + 2) + 3;
+  }
+
+  for (int y = 0; y < h; y++) {
+    const uint8_t* src = rgb + (size_t)y * rgb_stride;
+    uint8_t* bw = out_bw + (size_t)y * out_stride;
+    uint8_t* red = out_red + (size_t)y * out_stride;
+    memset(bw, 0, out_stride);
+    memset(red, 0, out_stride);
+
+    if (!diffuse) {
+      for (int x = 0; x < w; x++) {
+        int c[3];
+        to_ycc(src + x * bytes_per_pixel, c);
+        put_tricolor(bw, red, x, nearest_tricolor(c));
+      }
+      continue;
+    }
+
+    if (y & 1) tri_row<-1>(src, w, bytes_per_pixel, cur, next, bw, red);
+    else       tri_row<1>(src, w, bytes_per_pixel, cur, next, bw, red);
+
+    int16_t* t = cur;
+    cur = next;
+    next = t;
+  }
+
+  free(err);
+  return true;
+}
+
+static bool dither_gray(const uint8_t* gray, int w, int h, int gray_stride, uint8_t* out,
+                        DitherMethod method, uint8_t threshold, bool simd) {
+  if (!gray || !out || w <= 0 || h <= 0) return false;
+
+  switch (method) {
+    case DITHER_BAYER2:
+      dither_ordered(gray, w, h, gray_stride, out, 2, threshold, simd);
+      return true;
+    case DITHER_BAYER4:
+      dither_ordered(gray, w, h, gray_stride, out, 4, threshold, simd);
+      return true;
+    case DITHER_BAYER8:
+      dither_ordered(gray, w, h, gray_stride, out, 8, threshold, simd);
+      return true;
+    case DITHER_FLOYD_STEINBERG:
+      return dither_floyd_steinberg(gray, w, h, gray_stride, out, threshold);
+    case DITHER_ATKINSON:
+      return dither_atkinson(gray, w, h, gray_stride, out, threshold);
+    default:
+      dither_ordered(gray, w, h, gray_stride, out, 1, threshold, simd);
+      return true;
+  }
+}
+
+bool ditherGray(const uint8_t* gray, int w, int h, int gray_stride, uint8_t* out,
+                DitherMethod method, uint8_t threshold) {
+  return dither_gray(gray, w, h, gray_stride, out, method, threshold, true);
+}
+
+bool ditherGrayScalar(const uint8_t* gray, int w, int h, int gray_stride, uint8_t* out,
+                      DitherMethod method, uint8_t threshold) {
+  return dither_gray(gray, w, h, gray_stride, out, method, threshold, false);
+}
+
+const char* ditherImpl(void) {
+#if defined(__ARM_NEON)
+  return "NEON";
+#elif defined(__SSE2__)
+  return "SSE2";
+#else
+  return "scalar";
+#endif
+}
@@ -0,0 +1,59 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (C) 2025 Lese
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _DITHER_H
+#define _DITHER_H
+
+#include <cstdint>
+
+enum DitherMethod {
+    DITHER_THRESHOLD,       // Plain gray > threshold
+    DITHER_BAYER2,          // Ordered, 2x2 matrix
+    DITHER_BAYER4,          // Ordered, 4x4 matrix
+    DITHER_BAYER8,          // Ordered, 8x8 matrix
+    DITHER_FLOYD_STEINBERG, // Error diffusion, serpentine
+    DITHER_ATKINSON         // Error diffusion, 3/4 of the error, keeps contrast
+};
+
+// Converts 8-bit grayscale (0 = black, rows gray_stride bytes apart) into a
+// packed 1bpp plane, MSB first and 1 = white like the BW RAM, so the result
+// can go straight to displayImage() or drawBitmap(). out needs (w + 7) / 8
+// bytes per row. threshold is only used by the threshold and error
+// diffusion methods. Returns false if error diffusion can't get its row
+// buffers.
+bool ditherGray(const uint8_t* gray, int w, int h, int gray_stride, uint8_t* out,
+                DitherMethod method, uint8_t threshold = 127);
+// Same without the NEON/SSE2 rows of the ordered methods, as a reference
+bool ditherGrayScalar(const uint8_t* gray, int w, int h, int gray_stride, uint8_t* out,
+                      DitherMethod method, uint8_t threshold = 127);
+const char* ditherImpl(void); // "NEON", "SSE2" or "scalar"
+
+// Classifies RGB pixels (R, G, B first in each of bytes_per_pixel bytes,
+// so RGB888 or RGBA/RGBX) as white, black or red and writes both RAM
+// planes in one pass: out_bw 1 = white or red, out_red 1 = red. Colours
+// are compared in a luma/chroma space weighted towards luma, and with
+// diffuse the quantisation error is spread Floyd-Steinberg style in that
+// same space. Each plane needs (w + 7) / 8 bytes per row.
+bool ditherTricolor(const uint8_t* rgb, int w, int h, int rgb_stride, int bytes_per_pixel,
+                    uint8_t* out_bw, uint8_t* out_red, bool diffuse = true);
+
+#endif
@@ -21,16 +21,15 @@
  */
 
 #include "EinkDisplay.h"
+#include "SpidevTransport.h"
 #include <unistd.h>
-#include <fcntl.h>
-#include <sys/ioctl.h>
-#include <linux/spi/spidev.h>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <cerrno>
 #include <thread>
 #include <chrono>
+#include <algorithm>
 
 #define xy_swap(a, b) \
   (((a) ^= (b)), ((b) ^= (a)), ((a) ^= (b)))
@@ -40,100 +39,147 @@ static void delay(int ms) {
     std::this_thread::sleep_for(std::chrono::milliseconds(ms));
 }
 
-EinkDisplay::EinkDisplay(int einkheight, int einkwidth, const std::string& spi_device, int dc_gpio, int rst_gpio, int cs_gpio, int busy_gpio) :
-  GFX(einkwidth, einkheight),
-  eink_height(einkheight), eink_width(einkwidth),
-  spi_fd(-1),
-  spi_dev_path(spi_device),
-  dc_gpio(dc_gpio), cs_gpio(cs_gpio), busy_gpio(busy_gpio), rst_gpio(rst_gpio),
-  dc_fd(-1), cs_fd(-1), busy_fd(-1), rst_fd(-1)
+EinkDisplay::EinkDisplay(int einkheight, int einkwidth, const std::string& spi_device, int dc_gpio, int rst_gpio, int cs_gpio, int busy_gpio,
+                         const std::string& gpio_chip, uint32_t spi_speed_hz) :
+  EinkDisplay(einkheight, einkwidth, new SpidevTransport(spi_device, dc_gpio, rst_gpio, cs_gpio, busy_gpio, gpio_chip), true)
 {
+  this->spi_speed_hz = spi_speed_hz;
 }
 
-EinkDisplay::~EinkDisplay() {
-    if (spi_fd >= 0) close(spi_fd);
-    if (dc_fd >= 0) close(dc_fd);
-    if (cs_fd >= 0) close(cs_fd);
-    if (busy_fd >= 0) close(busy_fd);
-    if (rst_fd >= 0) close(rst_fd);
+EinkDisplay::EinkDisplay(int einkheight, int einkwidth, EinkTransport& transport) :
+  EinkDisplay(einkheight, einkwidth, &transport, false)
+{
 }
 
-bool EinkDisplay::begin() {
-    // Setup GPIOs
-    if (dc_gpio >= 0) {
-        gpio_export(dc_gpio);
-        gpio_direction_output(dc_gpio, 1);
-        dc_fd = gpio_open_value(dc_gpio, O_WRONLY);
-    }
-    
-    if (rst_gpio >= 0) {
-        gpio_export(rst_gpio);
-        gpio_direction_output(rst_gpio, 1);
-        rst_fd = gpio_open_value(rst_gpio, O_WRONLY);
-    }
+EinkDisplay::EinkDisplay(int einkheight, int einkwidth, EinkTransport* transport, bool owns_transport) :
+  GFX(einkwidth, einkheight),
+  eink_height(einkheight), eink_width(einkwidth),
+  bus(transport), owns_bus(owns_transport),
+  spi_speed_hz(DEFAULT_SPI_SPEED_HZ),
+  spi_bufsiz(0),
+  busy_timeout_ms(20000), last_busy_ms(0),
+  settle_ms(0), last_refresh_ms(0),
+  last_mode(MODE_NORMAL), policy(NULL),
+  loaded_waveform(NULL), temp_raw(0), temp_valid(false),
+  auto_fast_min(AUTO_FAST_MIN_TEMP), auto_partial_min(AUTO_PARTIAL_MIN_TEMP),
+  io_owned(false),
+  sleep_timeout_ms(0), sleep_stop(false), sleep_after_refresh(true),
+  arena(NULL), scratch(NULL),
+  shadow_bw(NULL), shadow_red(NULL), shadow_valid(0),
+  displayed_bw(NULL), saved_red(NULL), displayed_valid(false), red_borrowed(false),
+  asleep(true),
+  pending_bw(NULL), pending_red(NULL), front_bw(NULL), front_red(NULL),
+  frame_pending(false), worker_stop(false), worker_mode(MODE_NORMAL),
+  dc_level(-1),
+  glyph_font(NULL), glyph_stride(0)
+{
+  plane_stride = (eink_width + 7) / 8;
+  plane_size = (size_t)plane_stride * eink_height;
+
+  // 2 x 15000 bytes for 400x300, start out white with no red
+  buffer_bw = (uint8_t*)malloc(plane_size);
+  buffer_red = (uint8_t*)malloc(plane_size);
+  if (buffer_bw) memset(buffer_bw, 0xFF, plane_size);
+  if (buffer_red) memset(buffer_red, 0x00, plane_size);
+
+  for (int m = 0; m < 3; m++) {
+    waveforms[m] = NULL;
+    waveform_count[m] = 0;
+  }
 
-    if (cs_gpio >= 0) {
-        gpio_export(cs_gpio);
-        gpio_direction_output(cs_gpio, 1);
-        cs_fd = gpio_open_value(cs_gpio, O_WRONLY);
-    }
+  // RAM content is unknown until the first flush
+  dirty.reserve(MAX_DIRTY_RECTS);
+  whole_plane.reserve(1);
+  _markAllDirty();
 
-    if (busy_gpio >= 0) {
-        gpio_export(busy_gpio);
-        gpio_direction_input(busy_gpio);
-        busy_fd = gpio_open_value(busy_gpio, O_RDONLY);
-    }
+  // Largest sequence is prepare(), keep the queue from reallocating
+  batch_buf.reserve(64);
+  batch_runs.reserve(32);
+}
 
-    if (dc_fd < 0 || rst_fd < 0 || busy_fd < 0) {
-        fprintf(stderr, "Failed to open required GPIO value files (DC, RST, BUSY)\n");
-        return false;
-    }
-    // CS is optional if managed by spidev
-    if (cs_gpio >= 0 && cs_fd < 0) {
-         fprintf(stderr, "Failed to open CS GPIO value file\n");
-         return false;
+EinkDisplay::~EinkDisplay() {
+    stopWorker();
+    if (refresh_pending.valid()) refresh_pending.wait();
+    if (sleep_thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(io_mutex);
+            sleep_stop = true;
+        }
+        io_cv.notify_all();
+        sleep_thread.join();
     }
 
-    // Setup SPI
-    spi_fd = open(spi_dev_path.c_str(), O_RDWR);
-    if (spi_fd < 0) {
-        perror("Failed to open SPI device");
-        return false;
+    // Don't leave the panel powered
+    if (!asleep) {
+        _beginSPI();
+        _writeCommand(0x10); // Deep Sleep mode
+        _writeData(0x01);
+        asleep = true;
+        _endSPI();
     }
+    free(buffer_bw);
+    free(buffer_red);
+    free(arena);
+    if (owns_bus) delete bus;
+}
 
-    uint8_t mode = SPI_MODE_0;
-    uint8_t bits = 8;
-    uint32_t speed = 1000000; // Lowered to 1MHz for stability
+bool EinkDisplay::begin() {
+    // Keep the spidev default in line with the per-transfer clock
+    bus->setMaxSpeed(spi_speed_hz);
+    if (!bus->begin()) return false;
 
-    if (ioctl(spi_fd, SPI_IOC_WR_MODE, &mode) < 0) {
-        perror("SPI mode");
-        return false;
-    }
-    if (ioctl(spi_fd, SPI_IOC_WR_BITS_PER_WORD, &bits) < 0) {
-        perror("SPI bits");
-        return false;
-    }
-    if (ioctl(spi_fd, SPI_IOC_WR_MAX_SPEED_HZ, &speed) < 0) {
-        perror("SPI speed");
+    if (!_allocArena()) {
+        fprintf(stderr, "Failed to allocate transfer buffers\n");
         return false;
     }
 
     return true;
 }
 
+// One page-aligned block for every transfer buffer, so the update path
+// never has to go back to the allocator once begin() has succeeded.
+bool EinkDisplay::_allocArena(void) {
+    if (arena) return true;
+
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t slot = (plane_size + page - 1) / page * page;
+    void* mem = NULL;
+    if (posix_memalign(&mem, page, slot * ARENA_SLOTS) != 0) return false;
+
+    arena = (uint8_t*)mem;
+    scratch     = arena + slot * 0;
+    pending_bw  = arena + slot * 1;
+    pending_red = arena + slot * 2;
+    front_bw    = arena + slot * 3;
+    front_red   = arena + slot * 4;
+    shadow_bw   = arena + slot * 5;
+    shadow_red  = arena + slot * 6;
+    displayed_bw = arena + slot * 7;
+    saved_red    = arena + slot * 8;
+    return true;
+}
+
 void EinkDisplay::prepare(void) {
-  uint16_t eink_x = ((eink_width - 1) / 8);
+  _beginSPI();
+  _init();
+  _endSPI();
+}
+
+// Wakes the controller up from deep sleep, RAM contents survive it
+void EinkDisplay::_wake(void) {
+  if (asleep) _init();
+}
+
+void EinkDisplay::_init(void) {
   uint16_t eink_y = (eink_height - 1);
 
   // Hardware Reset
   delay(20);
-  gpio_set_value(rst_fd, 0);
+  bus->setReset(0);
   delay(20);
-  gpio_set_value(rst_fd, 1);
+  bus->setReset(1);
   delay(30);
 
-  _beginSPI();
-
   // Software Reset (from main.c in vendor code)
   _writeCommand(0x12);
   _waitWhileBusy();
@@ -147,21 +193,8 @@ void EinkDisplay::prepare(void) {
   _writeData((eink_y >> 8));  // 0x01
   _writeData(0x00);
 
-  // Data Entry Mode
-  _writeCommand(0x11);
-  _writeData(0x01); // Y decrement, X increment
-
-  // Set RAM X address Start/End
-  _writeCommand(0x44);
-  _writeData(0x00);           // Start
-  _writeData(eink_x);         // End (0x31 for 400 width / 8 - 1)
-
-  // Set RAM Y address Start/End
-  _writeCommand(0x45);
-  _writeData(eink_y);         // Start (0x12B)
-  _writeData((eink_y >> 8));
-  _writeData(0x00);           // End
-  _writeData(0x00);
+  // Data Entry Mode Y increment, X increment, full screen window
+  _setRamArea(0, 0, plane_stride - 1, eink_y);
 
   // Border Waveform Control
   _writeCommand(0x3C);
@@ -175,425 +208,1245 @@ void EinkDisplay::prepare(void) {
 
   // Note: Vendor INIT does NOT include 0x22 or 0x20. 
   // Those are done in the display update functions.
-  
-  _endSPI();
+
+  loaded_waveform = NULL; // Reset clears the LUT register
+  asleep = false;
 }
 
-void EinkDisplay::display(void) {
+bool EinkDisplay::display(void) {
   // Default to Normal/Slow mode if not specified, or keep existing behavior
   // Existing behavior was 0xC7. Vendor Slow is 0xF7.
   // Let's use displayNormal() logic here to be safe, or keep it separate.
   // For now, I'll just call displayNormal() as the default "display" action.
-  displayNormal();
+  return displayNormal();
+}
+
+bool EinkDisplay::displayNormal(void) {
+  return _refresh(MODE_NORMAL, buffer_red);
+}
+
+bool EinkDisplay::displayFast(void) {
+  return _refresh(MODE_FAST, buffer_red);
 }
 
-void EinkDisplay::displayNormal(void) {
+bool EinkDisplay::displayPartial(void) {
+  return _refresh(MODE_PARTIAL, buffer_red);
+}
+
+std::shared_future<bool> EinkDisplay::displayAsync(RefreshMode mode) {
+  // Waits for any refresh still in flight before touching the controller
   _beginSPI();
-  
-  _writeCommand(0x18); // Temperature sensor
-  _writeData(0x80);    // Internal
+  _startRefresh(mode, buffer_red);
+
+  // The controller stays owned by the refresh until BUSY drops, so
+  // drawing into the framebuffer can go on meanwhile and flush() or the
+  // next refresh simply queue up behind it in _beginSPI().
+  refresh_pending = std::async(std::launch::async, &EinkDisplay::_finishRefresh, this).share();
+  return refresh_pending;
+}
+
+bool EinkDisplay::_refresh(RefreshMode mode, const uint8_t* plane_red) {
+  _beginSPI();
+  _startRefresh(mode, plane_red);
+  return _finishRefresh();
+}
+
+// Caller owns the bus. A partial refresh needs to know exactly what is
+// on the glass, so without a complete BW shadow it falls back to a full one.
+void EinkDisplay::_startRefresh(RefreshMode mode, const uint8_t* plane_red) {
+  _wake();
+
+  // _finishRefresh() may run on the displayAsync() thread
+  {
+    std::lock_guard<std::mutex> lock(io_mutex);
+    sleep_after_refresh = (sleep_timeout_ms == 0);
+  }
+
+  if (mode == MODE_AUTO) mode = _autoMode(plane_red);
+  if (mode == MODE_PARTIAL && policy && !policy->partialAllowed()) mode = MODE_NORMAL;
+  if (mode == MODE_PARTIAL && (!displayed_valid || !(shadow_valid & 1))) mode = MODE_NORMAL;
+
+  if (mode == MODE_PARTIAL) {
+    // Display mode 2 takes the previous frame from red RAM, so keep what
+    // red RAM held (or should hold, if it was never written whole)
+    if (!red_borrowed) {
+      if (shadow_valid & 2) memcpy(saved_red, shadow_red, plane_size);
+      else if (plane_red) memcpy(saved_red, plane_red, plane_size);
+      else memset(saved_red, 0x00, plane_size);
+    }
+    _diffRects(NULL, displayed_bw, _wholePlane(), true);
+    _sendUploads(NULL, displayed_bw);
+    red_borrowed = true;
+  } else if (red_borrowed) {
+    _diffRects(NULL, saved_red, _wholePlane(), true);
+    _sendUploads(NULL, saved_red);
+    red_borrowed = false;
+  }
+
+  const Waveform* wf = _selectWaveform(mode);
+  if (wf) {
+    _loadWaveform(wf);
+  } else {
+    _writeCommand(0x18); // Temperature sensor
+    _writeData(0x80);    // Internal
+  }
 
   _writeCommand(0x21); // Display Update Control 1
-  _writeData(0x40);    // RAM -> Display (Source Output) ? Vendor uses 0x40 here.
+  if (mode == MODE_NORMAL) {
+    _writeData(0x40);  // RAM -> Display (Source Output) ? Vendor uses 0x40 here.
+  } else {
+    _writeData(0x00);  // Different from Normal (0x40), partial needs red RAM too
+  }
 
   _writeCommand(0x22); // Display Update Control 2
-  _writeData(0xF7);    // Vendor "Slow" mode sequence
+  if (wf) {
+    _writeData(mode == MODE_PARTIAL ? 0xCC : 0xC7); // Same without loading temperature and LUT
+  } else if (mode == MODE_FAST) {
+    _writeData(0xFF);  // Vendor "Fast" mode sequence
+  } else if (mode == MODE_PARTIAL) {
+    _writeData(0xFC);  // Display mode 2, keeps clock and analog on
+  } else {
+    _writeData(0xF7);  // Vendor "Slow" mode sequence
+  }
 
   _writeCommand(0x20); // Master Activation
-  _waitWhileBusy();
-  
-  // Force a delay to ensure update completes
-  delay(3000); // Keep the safety delay
+  _submitBatch();
+  if (!wf) loaded_waveform = NULL; // Replaced by the OTP one
+
+  // BW RAM is what the glass shows from now on
+  displayed_valid = shadow_bw && (shadow_valid & 1);
+  if (displayed_valid) memcpy(displayed_bw, shadow_bw, plane_size);
+
+  last_mode = mode;
+  if (policy) {
+    if (mode == MODE_PARTIAL) policy->partialDone();
+    else policy->fullDone();
+  }
+}
 
-  _writeCommand (0x10); // Deep Sleep mode
-  _writeData (0x01);
+bool EinkDisplay::_finishRefresh(void) {
+  bool ok = _waitWhileBusy();
+  last_refresh_ms = last_busy_ms;
+
+  // BUSY going low already means the waveform is done, the settle time
+  // is only for panels that need extra margin (0 by default)
+  if (settle_ms > 0) delay(settle_ms);
+
+  // Otherwise _sleepLoop() puts it to sleep once the bus has been idle
+  if (sleep_after_refresh) {
+    _writeCommand (0x10); // Deep Sleep mode
+    _writeData (0x01);
+    asleep = true;
+  }
   _endSPI();
+  return ok;
 }
 
-void EinkDisplay::displayFast(void) {
+// --- Custom waveforms ---
+
+void EinkDisplay::setWaveforms(RefreshMode mode, const Waveform* bands, int count) {
+  if (mode == MODE_AUTO) return; // Resolves to one of the others
   _beginSPI();
-  
+  waveforms[mode] = count > 0 ? bands : NULL;
+  waveform_count[mode] = count > 0 ? count : 0;
+  loaded_waveform = NULL; // The table may be reused with new contents
+  _endSPI();
+}
+
+// Reads the internal sensor through 0x1B. 0xA1 only loads the temperature,
+// so a custom LUT in the register survives.
+bool EinkDisplay::_readTemperature(void) {
   _writeCommand(0x18); // Temperature sensor
   _writeData(0x80);    // Internal
+  _writeCommand(0x22);
+  _writeData(0xA1);    // Clock on, load temperature, clock off
+  _writeCommand(0x20);
+  _submitBatch();
+  if (!_waitWhileBusy()) return false;
+
+  uint8_t cmd = 0x1B;
+  uint8_t raw[2];
+  bus->setCS(0);
+  _setDC(0);
+  spi_transfer(&cmd, 1);
+  _setDC(1);
+  spi_receive(raw, 2);
+  bus->setCS(1);
+
+  // 12 bit two's complement, left aligned so the shift sign-extends
+  temp_raw = (int16_t)((raw[0] << 8) | raw[1]) >> 4;
+  return true;
+}
 
-  _writeCommand(0x21); // Display Update Control 1
-  _writeData(0x00);    // Different from Normal (0x40)
+// Keeps the last reading if the sensor times out
+void EinkDisplay::_updateTemperature(bool force) {
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  if (!force && temp_valid && now - temp_time < std::chrono::milliseconds(TEMP_MAX_AGE_MS)) return;
+  if (_readTemperature()) {
+    temp_valid = true;
+    temp_time = now;
+  }
+}
 
-  _writeCommand(0x22); // Display Update Control 2
-  _writeData(0xFF);    // Vendor "Fast" mode sequence
+float EinkDisplay::readTemperature(void) {
+  _beginSPI();
+  _wake();
+  _updateTemperature(true);
+  _endSPI();
+  return temperature();
+}
 
-  _writeCommand(0x20); // Master Activation
-  _waitWhileBusy();
-  
-  // Force a delay to ensure update completes
-  delay(3000); // Keep the safety delay
+// Fast and partial waveforms smear when cold, so those only run from
+// their thresholds up, and not at all while the temperature is unknown.
+// Partial is BW only and would drop the red RAM contents from the glass.
+EinkDisplay::RefreshMode EinkDisplay::_autoMode(const uint8_t* plane_red) {
+  _updateTemperature(false);
+  if (!temp_valid) return MODE_NORMAL;
+  if (temp_raw < auto_fast_min * 16) return MODE_NORMAL;
+  if (temp_raw < auto_partial_min * 16) return MODE_FAST;
+
+  // What red RAM holds, or gets back with the next full refresh. The
+  // framebuffer only stands in when neither is known.
+  const uint8_t* red = plane_red;
+  if (red_borrowed) red = saved_red;
+  else if (shadow_valid & 2) red = shadow_red;
+
+  for (size_t i = 0; red && i < plane_size; i++)
+    if (red[i]) return MODE_FAST;
+  return MODE_PARTIAL;
+}
 
-  _writeCommand (0x10); // Deep Sleep mode
-  _writeData (0x01);
-  _endSPI();
+const EinkDisplay::Waveform* EinkDisplay::_selectWaveform(RefreshMode mode) {
+  const Waveform* bands = waveforms[mode];
+  if (!bands) return NULL;
+
+  // Without a reading the coldest band is the safe one
+  _updateTemperature(false);
+  int i = 0;
+  while (temp_valid && i + 1 < waveform_count[mode] && bands[i + 1].min_temp * 16 <= temp_raw) i++;
+  return &bands[i];
+}
+
+void EinkDisplay::_loadWaveform(const Waveform* w) {
+  if (w == loaded_waveform) return;
+
+  _writeCommand(0x32); // LUT
+  _sendData(w->lut, w->lut_len);
+
+  _writeCommand(0x3F); // End option
+  _writeData(w->eopt);
+  _writeCommand(0x03); // Gate voltage
+  _writeData(w->gate);
+  _writeCommand(0x04); // Source voltages
+  _writeData(w->source[0]);
+  _writeData(w->source[1]);
+  _writeData(w->source[2]);
+  _writeCommand(0x2C); // VCOM
+  _writeData(w->vcom);
+  loaded_waveform = w;
+}
+
+void EinkDisplay::setSleepTimeout(int ms) {
+  {
+    std::lock_guard<std::mutex> lock(io_mutex);
+    sleep_timeout_ms = ms;
+  }
+  io_cv.notify_all();
+  if (ms > 0 && !sleep_thread.joinable())
+    sleep_thread = std::thread(&EinkDisplay::_sleepLoop, this);
 }
 
+// Sends the controller to deep sleep once the bus has been released and
+// left alone for sleep_timeout_ms. Every _endSPI() restarts the wait.
+void EinkDisplay::_sleepLoop(void) {
+  std::unique_lock<std::mutex> lock(io_mutex);
+  while (!sleep_stop) {
+    if (io_owned || asleep || sleep_timeout_ms <= 0) {
+      io_cv.wait(lock);
+      continue;
+    }
+
+    std::chrono::steady_clock::time_point deadline = last_io + std::chrono::milliseconds(sleep_timeout_ms);
+    if (std::chrono::steady_clock::now() < deadline) {
+      io_cv.wait_until(lock, deadline);
+      continue;
+    }
+
+    io_owned = true;
+    lock.unlock();
+    _writeCommand(0x10); // Deep Sleep mode
+    _writeData(0x01);
+    asleep = true;
+    _endSPI();
+    lock.lock();
+  }
+}
+
+// The controller is owned by one sequence at a time. Ownership is a flag
+// rather than a held mutex so a refresh started on one thread can be
+// completed and released from another (see displayAsync()).
 void EinkDisplay::_beginSPI(void)
 {
+  std::unique_lock<std::mutex> lock(io_mutex);
+  io_cv.wait(lock, [this] { return !io_owned; });
+  io_owned = true;
 }
 
 void EinkDisplay::_endSPI(void)
 {
+  _submitBatch();
+
+  std::lock_guard<std::mutex> lock(io_mutex);
+  io_owned = false;
+  last_io = std::chrono::steady_clock::now();
+  io_cv.notify_all();
 }
 
 void EinkDisplay::_writeCommand(uint8_t command)
 {
-  gpio_set_value(dc_fd, 0);
-  if (cs_fd >= 0) gpio_set_value(cs_fd, 0);
-  spi_transfer_byte(command);
-  if (cs_fd >= 0) gpio_set_value(cs_fd, 1);
+  _queueByte(0, command);
 }
 
 void EinkDisplay::_writeData(uint8_t data)
 {
-  gpio_set_value(dc_fd, 1);
-  if (cs_fd >= 0) gpio_set_value(cs_fd, 0);
-  spi_transfer_byte(data);
-  if (cs_fd >= 0) gpio_set_value(cs_fd, 1);
+  _queueByte(1, data);
+}
+
+void EinkDisplay::_queueByte(uint8_t dc, uint8_t value)
+{
+  if (batch_runs.empty() || batch_runs.back().dc != dc) {
+    BatchRun run = { batch_buf.size(), 0, dc };
+    batch_runs.push_back(run);
+  }
+  batch_buf.push_back(value);
+  batch_runs.back().len++;
+}
+
+// DC cannot change in the middle of an SPI message, so each run of
+// command or parameter bytes goes out as one transfer and DC is only
+// touched when the level actually changes.
+void EinkDisplay::_submitBatch(void)
+{
+  if (batch_runs.empty()) return;
+
+  bus->setCS(0);
+  for (size_t i = 0; i < batch_runs.size(); i++) {
+    const BatchRun& run = batch_runs[i];
+    _setDC(run.dc);
+    spi_transfer(batch_buf.data() + run.offset, run.len);
+  }
+  bus->setCS(1);
+
+  batch_buf.clear();
+  batch_runs.clear();
+}
+
+void EinkDisplay::_setDC(int value)
+{
+  if (dc_level == value) return;
+  bus->setDC(value);
+  dc_level = value;
 }
 
 void EinkDisplay::_sendData(const uint8_t* data, size_t len) {
     if (len == 0) return;
-    gpio_set_value(dc_fd, 1);
-    if (cs_fd >= 0) gpio_set_value(cs_fd, 0);
+    _submitBatch();
+    _setDC(1);
+    bus->setCS(0);
     
-    // spidev has a limit on buffer size (often 4096 bytes).
-    // We should split larger transfers.
-    const size_t MAX_CHUNK = 4096;
+    // spidev caps a whole message (not each transfer) at its bufsiz, so
+    // anything larger goes out as one message per bufsiz chunk, with
+    // cs_change keeping CS asserted from one chunk to the next. With a
+    // large enough bufsiz a full plane is a single ioctl.
+    size_t max_chunk = spi_max_message();
     size_t offset = 0;
     while (offset < len) {
-        size_t chunk = (len - offset > MAX_CHUNK) ? MAX_CHUNK : (len - offset);
-        // We need to cast away const because spi_transfer takes non-const (it uses same buf for rx)
-        // But here we don't care about RX.
-        // Ideally we should copy to a temp buffer if we want to be strictly safe, 
-        // but spi_transfer implementation uses it as tx_buf.
-        spi_transfer(const_cast<uint8_t*>(data + offset), chunk);
+        size_t chunk = (len - offset > max_chunk) ? max_chunk : (len - offset);
+        spi_transfer(data + offset, chunk, offset + chunk < len);
         offset += chunk;
     }
 
-    if (cs_fd >= 0) gpio_set_value(cs_fd, 1);
+    bus->setCS(1);
 }
 
-uint8_t EinkDisplay::_readPixel(int16_t x, int16_t y, uint16_t color)
+void EinkDisplay::_setRamArea(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1)
 {
-  _writeCommand (0x41);//Read RAM option
-  _writeData(color);//0 = BW, 1 = RED RAM
+  // Data Entry Mode
+  _writeCommand(0x11);
+  _writeData(0x03); // Y increment, X increment
+
+  // Set RAM X address Start/End
+  _writeCommand(0x44);
+  _writeData(x0);
+  _writeData(x1);
+
+  // Set RAM Y address Start/End
+  _writeCommand(0x45);
+  _writeData(y0);
+  _writeData((y0 >> 8));
+  _writeData(y1);
+  _writeData((y1 >> 8));
 
   _writeCommand(0x4E);//Set RAM X address counter
-  _writeData((x / 8));
+  _writeData(x0);
   _writeCommand(0x4F);//Set RAM Y address counter
-  _writeData(y);
-  _writeData((y >> 8));
+  _writeData(y0);
+  _writeData((y0 >> 8));
+}
 
-  if (cs_fd >= 0) gpio_set_value(cs_fd, 0);
-  gpio_set_value(dc_fd, 0);
-  spi_transfer_byte(0x27);
-  gpio_set_value(dc_fd, 1);
-  
-  uint8_t result = spi_transfer_byte(0x27); // dummy read?
-  result = spi_transfer_byte(0x27); // actual data
-  
-  if (cs_fd >= 0) gpio_set_value(cs_fd, 1);
-  return result;
+void EinkDisplay::_markDirty(int16_t x0, int16_t y0, int16_t x1, int16_t y1)
+{
+  DirtyRect r = { (uint16_t)(x0 / 8), (uint16_t)y0, (uint16_t)(x1 / 8), (uint16_t)y1 };
+  _addDirty(dirty, r);
+}
+
+void EinkDisplay::_addDirty(std::vector<DirtyRect>& list, DirtyRect r)
+{
+  // Grow an existing rect that overlaps or touches the new one
+  for (size_t i = 0; i < list.size(); i++) {
+    DirtyRect& d = list[i];
+    if (r.x0 >= d.x0 && r.x1 <= d.x1 && r.y0 >= d.y0 && r.y1 <= d.y1) return;
+    if (r.x0 <= d.x1 + 1 && d.x0 <= r.x1 + 1 && r.y0 <= d.y1 + 1 && d.y0 <= r.y1 + 1) {
+      r.x0 = std::min(r.x0, d.x0);
+      r.y0 = std::min(r.y0, d.y0);
+      r.x1 = std::max(r.x1, d.x1);
+      r.y1 = std::max(r.y1, d.y1);
+      list.erase(list.begin() + i);
+      i = (size_t)-1; // The union may now reach other rects
+    }
+  }
+
+  if (list.size() < MAX_DIRTY_RECTS) {
+    list.push_back(r);
+    return;
+  }
+
+  // Out of slots, merge into the rect whose area grows the least
+  size_t best = 0;
+  long best_growth = -1;
+  for (size_t i = 0; i < list.size(); i++) {
+    const DirtyRect& d = list[i];
+    long area = (long)(d.x1 - d.x0 + 1) * (d.y1 - d.y0 + 1);
+    long merged = (long)(std::max(r.x1, d.x1) - std::min(r.x0, d.x0) + 1) *
+                  (std::max(r.y1, d.y1) - std::min(r.y0, d.y0) + 1);
+    if (best_growth < 0 || merged - area < best_growth) {
+      best = i;
+      best_growth = merged - area;
+    }
+  }
+  DirtyRect d = list[best];
+  list.erase(list.begin() + best);
+  DirtyRect u = { std::min(r.x0, d.x0), std::min(r.y0, d.y0),
+                  std::max(r.x1, d.x1), std::max(r.y1, d.y1) };
+  _addDirty(list, u);
+}
+
+void EinkDisplay::_markAllDirty(void)
+{
+  DirtyRect r = { 0, 0, (uint16_t)(plane_stride - 1), (uint16_t)(eink_height - 1) };
+  dirty.clear();
+  dirty.push_back(r);
+}
+
+std::vector<EinkDisplay::DirtyRect>& EinkDisplay::_wholePlane(void)
+{
+  DirtyRect r = { 0, 0, (uint16_t)(plane_stride - 1), (uint16_t)(eink_height - 1) };
+  whole_plane.assign(1, r); // Within the reserved capacity
+  return whole_plane;
+}
+
+void EinkDisplay::_uploadRect(const DirtyRect& r, const uint8_t* plane_bw, const uint8_t* plane_red, uint8_t planes)
+{
+  uint16_t w = r.x1 - r.x0 + 1;
+  uint16_t h = r.y1 - r.y0 + 1;
+  size_t len = (size_t)w * h;
+  const uint8_t* srcs[2] = { plane_bw, plane_red };
+  uint8_t* shadows[2] = { shadow_bw, shadow_red };
+  const uint8_t ram[2] = { 0x24, 0x26 };
+
+  for (int p = 0; p < 2; p++) {
+    if (!(planes & (1 << p))) continue;
+    const uint8_t* src = srcs[p] + (size_t)r.y0 * plane_stride + r.x0;
+
+    if (shadows[p]) {
+      for (uint16_t y = 0; y < h; y++)
+        memcpy(shadows[p] + (size_t)(r.y0 + y) * plane_stride + r.x0, src + (size_t)y * plane_stride, w);
+    }
+
+    _setRamArea(r.x0, r.y0, r.x1, r.y1);
+    _writeCommand(ram[p]);
+    if (w == plane_stride) {
+      // Full-width rows are already contiguous
+      _sendData(src, len);
+    } else if (scratch) {
+      for (uint16_t y = 0; y < h; y++)
+        memcpy(scratch + (size_t)y * w, src + (size_t)y * plane_stride, w);
+      _sendData(scratch, len);
+    } else {
+      for (uint16_t y = 0; y < h; y++)
+        _sendData(src + (size_t)y * plane_stride, w);
+    }
+  }
+}
+
+// First and last byte where two rows differ. The unchanged case is a
+// single (vectorised) memcmp, locating the ends goes 8 bytes at a time.
+static bool diff_span(const uint8_t* a, const uint8_t* b, int n, int* first, int* last)
+{
+  if (memcmp(a, b, n) == 0) return false;
+
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    uint64_t x, y;
+    memcpy(&x, a + i, 8);
+    memcpy(&y, b + i, 8);
+    if (x != y) break;
+  }
+  while (a[i] == b[i]) i++;
+
+  int j = n;
+  for (; j - 8 >= i; j -= 8) {
+    uint64_t x, y;
+    memcpy(&x, a + j - 8, 8);
+    memcpy(&y, b + j - 8, 8);
+    if (x != y) break;
+  }
+  while (a[j - 1] == b[j - 1]) j--;
+
+  *first = i;
+  *last = j - 1;
+  return true;
+}
+
+// Turns rects that may have changed into bands of rows that did change,
+// each narrowed to the changed bytes unless full_rows is set (contiguous
+// rows need no gathering). Unchanged rows up to DIFF_BAND_GAP are bridged
+// since every band costs a RAM window setup. Clears rects, returns
+// whether anything needs uploading.
+bool EinkDisplay::_diffRects(const uint8_t* plane_bw, const uint8_t* plane_red, std::vector<DirtyRect>& rects, bool full_rows)
+{
+  uploads.clear();
+
+  for (size_t i = 0; i < rects.size(); i++) {
+    const DirtyRect& r = rects[i];
+
+    // Planes without a complete shadow go up whole
+    uint8_t wanted = (plane_bw ? 1 : 0) | (plane_red ? 2 : 0);
+    uint8_t blind = wanted & ~shadow_valid;
+    if (blind) {
+      Upload u = { r, blind };
+      uploads.push_back(u);
+    }
+    uint8_t diffed = wanted & shadow_valid;
+    if (!diffed) continue;
+
+    int w = r.x1 - r.x0 + 1;
+    bool open = false;
+    Upload band = { r, 0 };
+    uint16_t last_changed = 0;
+
+    for (uint16_t y = r.y0; y <= r.y1; y++) {
+      size_t off = (size_t)y * plane_stride + r.x0;
+      int f0 = 0, l0 = 0, f1 = 0, l1 = 0;
+      bool c0 = (diffed & 1) && diff_span(plane_bw + off, shadow_bw + off, w, &f0, &l0);
+      bool c1 = (diffed & 2) && diff_span(plane_red + off, shadow_red + off, w, &f1, &l1);
+
+      if (c0 || c1) {
+        int first = (c0 && c1) ? std::min(f0, f1) : (c0 ? f0 : f1);
+        int last  = (c0 && c1) ? std::max(l0, l1) : (c0 ? l0 : l1);
+        if (full_rows) {
+          first = 0;
+          last = w - 1;
+        }
+        if (!open) {
+          band.r.x0 = r.x0 + first;
+          band.r.x1 = r.x0 + last;
+          band.r.y0 = y;
+          band.planes = 0;
+          open = true;
+        } else {
+          band.r.x0 = std::min<uint16_t>(band.r.x0, r.x0 + first);
+          band.r.x1 = std::max<uint16_t>(band.r.x1, r.x0 + last);
+        }
+        band.planes |= (c0 ? 1 : 0) | (c1 ? 2 : 0);
+        last_changed = y;
+      } else if (open && y - last_changed > DIFF_BAND_GAP) {
+        band.r.y1 = last_changed;
+        uploads.push_back(band);
+        open = false;
+      }
+    }
+
+    if (open) {
+      band.r.y1 = last_changed;
+      uploads.push_back(band);
+    }
+  }
+
+  rects.clear();
+  return !uploads.empty();
+}
+
+// Sends what _diffRects() found. Caller owns the bus.
+void EinkDisplay::_sendUploads(const uint8_t* plane_bw, const uint8_t* plane_red)
+{
+  for (size_t i = 0; i < uploads.size(); i++) {
+    const Upload& u = uploads[i];
+    _uploadRect(u.r, plane_bw, plane_red, u.planes);
+
+    // Once a plane has been written whole its shadow is complete
+    if (shadow_bw && u.r.x0 == 0 && u.r.y0 == 0 &&
+        u.r.x1 == plane_stride - 1 && u.r.y1 == eink_height - 1)
+      shadow_valid |= u.planes;
+  }
+  uploads.clear();
 }
 
-void EinkDisplay::_waitWhileBusy()
+// Reads a RAM window back through 0x27. Caller owns the bus.
+bool EinkDisplay::_readRam(uint8_t plane, uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, uint8_t* out)
 {
-  while (gpio_get_value(busy_fd) == 1) {
+  size_t len = (size_t)(x1 - x0 + 1) * (y1 - y0 + 1);
+  uint8_t dummy;
+
+  _writeCommand (0x41);//Read RAM option
+  _writeData(plane);//0 = BW, 1 = RED RAM
+  _setRamArea(x0, y0, x1, y1);
+  _submitBatch();
+
+  uint8_t cmd = 0x27;
+  bus->setCS(0);
+  _setDC(0);
+  spi_transfer(&cmd, 1);
+  _setDC(1);
+  spi_receive(&dummy, 1); // First byte after 0x27 is a dummy
+  spi_receive(out, len);
+  bus->setCS(1);
+  return true;
+}
+
+// Sleeps on BUSY falling edges when the GPIO backend reports them, and
+// falls back to polling every 1 ms otherwise.
+bool EinkDisplay::_waitWhileBusy()
+{
+  _submitBatch();
+
+  double start = bus->nowMs(); // Virtual on the simulator
+  int elapsed = 0;
+  bool ready = true;
+
+  while (bus->getBusy() == 1) {
+    if (busy_timeout_ms > 0 && elapsed >= busy_timeout_ms) {
+      fprintf(stderr, "Timed out after %d ms waiting for BUSY\n", elapsed);
+      ready = false;
+      break;
+    }
+
+    // A stale or spurious edge just sends us around to re-check the level
+    int timeout = (busy_timeout_ms > 0) ? (busy_timeout_ms - elapsed) : -1;
+    if (bus->waitBusyEdge(timeout) < 0) {
       delay(1);
+    }
+
+    elapsed = (int)(bus->nowMs() - start);
+  }
+
+  last_busy_ms = elapsed;
+  return ready;
+}
+
+void EinkDisplay::_rotate(int16_t& x, int16_t& y) const {
+  switch (getRotation()) {
+    case 1:
+      xy_swap(x, y);
+      x = WIDTH - x - 1;
+      break;
+    case 2:
+      x = WIDTH  - x - 1;
+      y = HEIGHT - y - 1;
+      break;
+    case 3:
+      xy_swap(x, y);
+      y = HEIGHT - y - 1;
+      break;
   }
 }
 
 void EinkDisplay::drawPixel(int16_t x, int16_t y, uint16_t color) {
   if ((x >= 0) && (x < width()) && (y >= 0) && (y < height())) {
-    switch (getRotation()) {
-      case 1:
-        xy_swap(x, y);
-        x = WIDTH - x - 1;
+    _rotate(x, y);
+
+    if (!buffer_bw || !buffer_red) return;
+
+    size_t idx = (size_t)y * plane_stride + (x / 8);
+    uint8_t bit = (1 << (7 - x % 8));
+
+    _markDirty(x, y, x, y);
+
+    switch (color) {
+      case BLACK:
+        buffer_bw[idx] &= ~bit;
+        buffer_red[idx] &= ~bit;
         break;
-      case 2:
-        x = WIDTH  - x - 1;
-        y = HEIGHT - y - 1;
+      case RED:
+        buffer_bw[idx] |= bit;
+        buffer_red[idx] |= bit;
         break;
-      case 3:
-        xy_swap(x, y);
-        y = HEIGHT - y - 1;
+      default: // WHITE
+        buffer_bw[idx] |= bit;
+        buffer_red[idx] &= ~bit;
         break;
     }
+  }
+}
+
+// Byte patterns that paint a color into the BW and red planes
+static inline void color_planes(uint16_t color, uint8_t& bw, uint8_t& red) {
+  bw  = (color == BLACK) ? 0x00 : 0xFF;
+  red = (color == RED)   ? 0xFF : 0x00;
+}
+
+void EinkDisplay::drawFastHLine(int16_t x, int16_t y, int16_t w, uint16_t color) {
+    fillRect(x, y, w, 1, color);
+}
+
+void EinkDisplay::drawFastVLine(int16_t x, int16_t y, int16_t h, uint16_t color) {
+    fillRect(x, y, 1, h, color);
+}
+
+void EinkDisplay::fillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color) {
+  // Clip in rotated coordinates, using ints so x + w can't overflow
+  int x0 = x, y0 = y, x1 = x + w - 1, y1 = y + h - 1;
+  if (w < 0) { x0 = x + w + 1; x1 = x; }
+  if (h < 0) { y0 = y + h + 1; y1 = y; }
+  if (x0 < 0) x0 = 0;
+  if (y0 < 0) y0 = 0;
+  if (x1 >= width())  x1 = width() - 1;
+  if (y1 >= height()) y1 = height() - 1;
+  if (w == 0 || h == 0 || x0 > x1 || y0 > y1) return;
+
+  // A rotated rectangle is still a rectangle, just map its corners
+  switch (getRotation()) {
+    case 1:
+      _fillPhysical(WIDTH - y1 - 1, x0, WIDTH - y0 - 1, x1, color);
+      break;
+    case 2:
+      _fillPhysical(WIDTH - x1 - 1, HEIGHT - y1 - 1, WIDTH - x0 - 1, HEIGHT - y0 - 1, color);
+      break;
+    case 3:
+      _fillPhysical(y0, HEIGHT - x1 - 1, y1, HEIGHT - x0 - 1, color);
+      break;
+    default:
+      _fillPhysical(x0, y0, x1, y1, color);
+      break;
+  }
+}
+
+// Each row is a masked first byte, a memset of the middle and a masked last
+// byte in both planes. A one pixel wide rect is the strided single-bit case.
+void EinkDisplay::_fillPhysical(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint16_t color) {
+  if (!buffer_bw || !buffer_red) return;
+
+  _markDirty(x0, y0, x1, y1);
+
+  uint8_t bw, red;
+  color_planes(color, bw, red);
+
+  int16_t first = x0 / 8, last = x1 / 8;
+  uint8_t first_mask = 0xFF >> (x0 % 8);
+  uint8_t last_mask  = (uint8_t)(0xFF << (7 - x1 % 8));
+  if (first == last) first_mask &= last_mask;
+
+  for (int16_t y = y0; y <= y1; y++) {
+    uint8_t* row_bw  = buffer_bw  + (size_t)y * plane_stride;
+    uint8_t* row_red = buffer_red + (size_t)y * plane_stride;
+
+    row_bw[first]  = (row_bw[first]  & ~first_mask) | (bw  & first_mask);
+    row_red[first] = (row_red[first] & ~first_mask) | (red & first_mask);
+    if (last > first) {
+      memset(row_bw  + first + 1, bw,  last - first - 1);
+      memset(row_red + first + 1, red, last - first - 1);
+      row_bw[last]  = (row_bw[last]  & ~last_mask) | (bw  & last_mask);
+      row_red[last] = (row_red[last] & ~last_mask) | (red & last_mask);
+    }
+  }
+}
 
-    uint8_t eink_x = (x / 8);
-    uint16_t eink_y = y;
-    uint8_t curr_black;
-    uint8_t curr_red;
+void EinkDisplay::_buildGlyphCache(void) {
+  int16_t glyphs = font->last - font->first + 1;
+  int16_t rows = font->line_height;
+  int16_t row_bytes = (font->width + 7) / 8;
 
-    _beginSPI();
-    curr_black = _readPixel(x, y, 0); //read black pixel
-    curr_red = _readPixel(x, y, 1); //read red pixel
+  // A cell shifted by up to 7 bits can straddle one extra byte
+  glyph_stride = (font->advance + 7 + 7) / 8;
+  glyph_cache.assign((size_t)glyphs * 8 * rows * glyph_stride, 0);
+  glyph_box.assign(8 * glyph_stride, 0);
 
-    curr_black = (curr_black & (0xFF ^ (1 << (7 - x % 8))));
-    curr_red = (curr_red & (0xFF ^ (1 << (7 - x % 8))));
+  for (int shift = 0; shift < 8; shift++) {
+    for (int col = 0; col < font->advance; col++) {
+      glyph_box[shift * glyph_stride + (shift + col) / 8] |= 0x80 >> ((shift + col) % 8);
+    }
+  }
 
-    if (color == BLACK) curr_black = (curr_black | (1 << (7 - x % 8)));
-    if (color == RED) curr_red = (curr_red | (1 << (7 - x % 8)));
+  for (int16_t g = 0; g < glyphs; g++) {
+    const uint8_t* src = font->bitmap + (size_t)g * font->height * row_bytes;
+    for (int shift = 0; shift < 8; shift++) {
+      uint8_t* dst = glyph_cache.data() + ((size_t)g * 8 + shift) * rows * glyph_stride;
+      for (int16_t row = 0; row < font->height && row < rows; row++) {
+        for (int col = 0; col < font->width; col++) {
+          if (src[row * row_bytes + col / 8] & (0x80 >> (col % 8))) {
+            dst[row * glyph_stride + (shift + col) / 8] |= 0x80 >> ((shift + col) % 8);
+          }
+        }
+      }
+    }
+  }
 
-    //Writing Black/Wide pixel
-    _writeCommand(0x4E);//Set RAM X address counter
-    _writeData(eink_x);
-    _writeCommand(0x4F);//Set RAM Y address counter
-    _writeData(eink_y);
-    _writeData((eink_y >> 8));
+  glyph_font = font;
+}
 
-    _writeCommand(0x24);//WRITE RAM BW
-    _writeData(curr_black);
+// Unscaled text at rotation 0 is blitted a byte at a time from the shifted
+// glyph cache, everything else goes through the generic span version
+void EinkDisplay::drawChar(int16_t x, int16_t y, char c, uint16_t color, uint16_t bg, uint8_t size) {
+  if (size != 1 || getRotation() != 0 || !buffer_bw || !buffer_red ||
+      x < 0 || y < 0 || x + font->advance > WIDTH || y + font->line_height > HEIGHT) {
+    GFX::drawChar(x, y, c, color, bg, size);
+    return;
+  }
 
-    _writeCommand(0x26);//WRITE RAM RED
-    _writeData(curr_red);
-    _endSPI();
+  uint8_t ch = (uint8_t)c;
+  if (ch < font->first || ch > font->last) ch = '?';
+  if (ch < font->first || ch > font->last) return;
+
+  if (glyph_font != font) _buildGlyphCache();
+
+  int16_t rows = font->line_height;
+  int shift = x & 7;
+  const uint8_t* glyph = glyph_cache.data() + ((size_t)(ch - font->first) * 8 + shift) * rows * glyph_stride;
+  const uint8_t* box = glyph_box.data() + shift * glyph_stride;
+  bool opaque = (bg != color);
+
+  uint8_t fg_bw, fg_red, bg_bw, bg_red;
+  color_planes(color, fg_bw, fg_red);
+  color_planes(bg, bg_bw, bg_red);
+
+  // The last shifted byte may be past the end of the row, it's all zero mask then
+  int16_t bytes = plane_stride - x / 8;
+  if (bytes > glyph_stride) bytes = glyph_stride;
+
+  _markDirty(x, y, x + font->advance - 1, y + rows - 1);
+
+  for (int16_t row = 0; row < rows; row++) {
+    uint8_t* row_bw  = buffer_bw  + (size_t)(y + row) * plane_stride + x / 8;
+    uint8_t* row_red = buffer_red + (size_t)(y + row) * plane_stride + x / 8;
+    const uint8_t* bits = glyph + row * glyph_stride;
+
+    for (int16_t b = 0; b < bytes; b++) {
+      uint8_t on   = bits[b];
+      uint8_t mask = opaque ? box[b] : on;
+      uint8_t off  = mask & ~on;
+      row_bw[b]  = (row_bw[b]  & ~mask) | (on & fg_bw)  | (off & bg_bw);
+      row_red[b] = (row_red[b] & ~mask) | (on & fg_red) | (off & bg_red);
+    }
   }
 }
 
-void EinkDisplay::drawFastHLine(int16_t x, int16_t y, int16_t w, uint16_t color) {
-    for(int16_t i=0; i<w; i++) drawPixel(x+i, y, color);
+// Big-endian loads and stores of up to 4 bytes, bit 31 is the leftmost pixel
+static inline uint32_t be32(uint32_t v) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  return __builtin_bswap32(v);
+#else
+  return v;
+#endif
 }
 
-void EinkDisplay::drawFastVLine(int16_t x, int16_t y, int16_t h, uint16_t color) {
-    for(int16_t i=0; i<h; i++) drawPixel(x, y+i, color);
+static inline uint32_t load_bits(const uint8_t* p, int n) {
+  uint32_t v = 0;
+  if (n >= 4) {
+    memcpy(&v, p, 4);
+    return be32(v);
+  }
+  for (int i = 0; i < 4; i++) v = (v << 8) | ((i < n) ? p[i] : 0);
+  return v;
+}
+
+static inline void store_bits(uint8_t* p, int n, uint32_t v) {
+  if (n >= 4) {
+    v = be32(v);
+    memcpy(p, &v, 4);
+    return;
+  }
+  for (int i = 0; i < n; i++) p[i] = v >> (24 - 8 * i);
+}
+
+// 32 bits of a packed row starting at any bit offset >= -8, bits outside
+// the row read as 0. Goes through a 40 bit window so the shift is one op.
+static inline uint32_t fetch_bits(const uint8_t* row, int row_bytes, int bit) {
+  int byte = (bit + 8) / 8 - 1;
+  int shift = (bit + 8) % 8;
+  uint64_t v = 0;
+  if (byte >= 0 && byte + 5 <= row_bytes) {
+    v = ((uint64_t)load_bits(row + byte, 4) << 8) | row[byte + 4];
+  } else {
+    for (int i = 0; i < 5; i++) {
+      int idx = byte + i;
+      v = (v << 8) | ((idx >= 0 && idx < row_bytes) ? row[idx] : 0);
+    }
+  }
+  return (uint32_t)(v >> (8 - shift));
+}
+
+static inline uint32_t apply_rop(EinkDisplay::RasterOp rop, uint32_t dst, uint32_t src) {
+  switch (rop) {
+    case EinkDisplay::ROP_OR:     return dst | src;
+    case EinkDisplay::ROP_AND:    return dst & src;
+    case EinkDisplay::ROP_XOR:    return dst ^ src;
+    case EinkDisplay::ROP_INVERT: return ~src;
+    default:                      return src;
+  }
+}
+
+// Writes the raw bits of one plane. At rotation 0 each row goes out 32
+// destination pixels at a time: the source is fetched at whatever bit
+// offset lines it up with the destination word, so unaligned x costs the
+// same as aligned. Rotated bitmaps are done pixel by pixel.
+void EinkDisplay::drawBitmap(int16_t x, int16_t y, int16_t w, int16_t h, const uint8_t* data, Plane plane, RasterOp rop) {
+  if (!data || w <= 0 || h <= 0 || !buffer_bw || !buffer_red) return;
+
+  int src_stride = (w + 7) / 8;
+  uint8_t* dst_plane = (plane == PLANE_RED) ? buffer_red : buffer_bw;
+
+  // Clip in rotated coordinates, sx/sy is the first visible source pixel
+  int x0 = x, y0 = y, cw = w, ch = h, sx = 0, sy = 0;
+  if (x0 < 0) { sx = -x0; cw += x0; x0 = 0; }
+  if (y0 < 0) { sy = -y0; ch += y0; y0 = 0; }
+  if (x0 + cw > width())  cw = width() - x0;
+  if (y0 + ch > height()) ch = height() - y0;
+  if (cw <= 0 || ch <= 0) return;
+
+  if (getRotation() != 0) {
+    for (int j = 0; j < ch; j++) {
+      const uint8_t* src = data + (size_t)(sy + j) * src_stride;
+      for (int i = 0; i < cw; i++) {
+        uint32_t s = (src[(sx + i) / 8] & (0x80 >> ((sx + i) % 8))) ? 1 : 0;
+        int16_t px = x0 + i, py = y0 + j;
+        _rotate(px, py);
+        _markDirty(px, py, px, py);
+
+        uint8_t* d = dst_plane + (size_t)py * plane_stride + px / 8;
+        int shift = 7 - px % 8;
+        uint32_t r = apply_rop(rop, (*d >> shift) & 1, s) & 1;
+        *d = (*d & ~(1 << shift)) | (r << shift);
+      }
+    }
+    return;
+  }
+
+  _markDirty(x0, y0, x0 + cw - 1, y0 + ch - 1);
+
+  int first = x0 / 8, last = (x0 + cw - 1) / 8;
+  int end = x0 + cw; // One past the last pixel
+
+  for (int j = 0; j < ch; j++) {
+    const uint8_t* src = data + (size_t)(sy + j) * src_stride;
+    uint8_t* dst = dst_plane + (size_t)(y0 + j) * plane_stride;
+
+    for (int byte = first; byte <= last; byte += 4) {
+      int n = plane_stride - byte;
+      int bit = byte * 8; // First pixel covered by this word
+
+      uint32_t mask = 0xFFFFFFFF;
+      if (bit < x0) mask >>= (x0 - bit);
+      if (bit + 32 > end) mask &= 0xFFFFFFFF << (bit + 32 - end);
+
+      uint32_t s = fetch_bits(src, src_stride, sx + bit - x0);
+      uint32_t d = load_bits(dst + byte, n);
+      store_bits(dst + byte, n, (d & ~mask) | (apply_rop(rop, d, s) & mask));
+    }
+  }
 }
 
 void EinkDisplay::clearDisplay(void) {
-    uint16_t w = (eink_width + 7) / 8;
-    uint16_t h = eink_height;
-    size_t total_bytes = w * h;
-    
-    // Allocate a buffer for one full frame (or at least a large chunk)
-    // For 400x300, w=50, h=300, total=15000 bytes.
-    // We can allocate this on heap.
-    uint8_t* buffer = (uint8_t*)malloc(total_bytes);
-    if (!buffer) return;
+    if (!buffer_bw || !buffer_red) return;
 
-    _beginSPI();
-    
-    // White for BW RAM (0xFF)
-    memset(buffer, 0xFF, total_bytes);
-    _writeCommand(0x24);
-    _sendData(buffer, total_bytes);
-
-    // No Red (0x00)
-    memset(buffer, 0x00, total_bytes);
-    _writeCommand(0x26);
-    _sendData(buffer, total_bytes);
-    
-    _endSPI();
-    free(buffer);
+    memset(buffer_bw, 0xFF, plane_size); // White for BW RAM (0xFF)
+    memset(buffer_red, 0x00, plane_size); // No Red (0x00)
+    _markAllDirty();
+    flush();
 }
 
 void EinkDisplay::fillBlack(void) {
-    uint16_t w = (eink_width + 7) / 8;
-    uint16_t h = eink_height;
-    size_t total_bytes = w * h;
-    
-    uint8_t* buffer = (uint8_t*)malloc(total_bytes);
-    if (!buffer) return;
+    if (!buffer_bw || !buffer_red) return;
 
+    memset(buffer_bw, 0x00, plane_size); // Black for BW RAM (0x00)
+    memset(buffer_red, 0x00, plane_size); // No Red (0x00)
+    _markAllDirty();
+    flush();
+}
+
+bool EinkDisplay::flush(void) {
+    if (!buffer_bw || !buffer_red) return false;
+    return _flushPlanes(buffer_bw, buffer_red, dirty);
+}
+
+// Copies the rects of plane_red into saved_red, which stands in for red
+// RAM while a partial refresh borrows it. A change there still needs a
+// (full) refresh, so it counts like an upload.
+bool EinkDisplay::_saveRed(const uint8_t* plane_red, const std::vector<DirtyRect>& rects) {
+    bool changed = false;
+    for (size_t i = 0; i < rects.size(); i++) {
+        const DirtyRect& r = rects[i];
+        for (uint16_t y = r.y0; y <= r.y1; y++) {
+            size_t off = (size_t)y * plane_stride + r.x0;
+            size_t len = r.x1 - r.x0 + 1;
+            if (memcmp(saved_red + off, plane_red + off, len) == 0) continue;
+            memcpy(saved_red + off, plane_red + off, len);
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+bool EinkDisplay::_flushPlanes(const uint8_t* plane_bw, const uint8_t* plane_red, std::vector<DirtyRect>& rects) {
     _beginSPI();
-    
-    // Black for BW RAM (0x00)
-    memset(buffer, 0x00, total_bytes);
-    _writeCommand(0x24);
-    _sendData(buffer, total_bytes);
-
-    // No Red (0x00)
-    memset(buffer, 0x00, total_bytes);
-    _writeCommand(0x26);
-    _sendData(buffer, total_bytes);
-    
+
+    // Borrowed red RAM holds the previous frame, the red plane goes
+    // back with the next full refresh
+    bool red_changed = false;
+    if (red_borrowed) {
+        red_changed = _saveRed(plane_red, rects);
+        plane_red = NULL;
+    }
+    bool changed = _diffRects(plane_bw, plane_red, rects, false);
+    if (changed) _wake();
+    changed = changed || red_changed;
+    _sendUploads(plane_bw, plane_red);
+
     _endSPI();
-    free(buffer);
+    return changed;
 }
 
-void EinkDisplay::displayImage(const uint8_t* image_bw, const uint8_t* image_red) {
-    uint16_t w = (eink_width + 7) / 8;
-    uint16_t h = eink_height;
-    size_t total_bytes = w * h;
+// --- Double buffering ---
 
-    _beginSPI();
+bool EinkDisplay::startWorker(RefreshMode mode) {
+    if (worker_thread.joinable()) return true;
+    if (!buffer_bw || !buffer_red || !arena) return false; // Needs begin()
 
-    // Set RAM X address counter to 0
-    _writeCommand(0x4E);
-    _writeData(0x00);
-    
-    // Set RAM Y address counter to eink_height - 1
-    _writeCommand(0x4F);
-    _writeData(eink_height - 1);
-    _writeData((eink_height - 1) >> 8);
-
-    // BW RAM
-    _writeCommand(0x24);
-    if (image_bw) {
-        // Vertical Flip (Fix for "Up/Down Left/Right reversed")
-        uint8_t* buffer = (uint8_t*)malloc(total_bytes);
-        if (buffer) {
-            for (int y = 0; y < h; y++) {
-                // Copy row 'y' from source to row 'h-1-y' in destination
-                memcpy(buffer + (h - 1 - y) * w, image_bw + y * w, w);
-            }
-            _sendData(buffer, total_bytes);
-            free(buffer);
-        } else {
-            _sendData(image_bw, total_bytes);
+    pending_dirty.reserve(MAX_DIRTY_RECTS);
+    front_dirty.reserve(MAX_DIRTY_RECTS);
+    worker_mode = mode;
+    frame_pending = false;
+    worker_stop = false;
+    worker_thread = std::thread(&EinkDisplay::_workerLoop, this);
+    return true;
+}
+
+void EinkDisplay::stopWorker(void) {
+    if (!worker_thread.joinable()) return;
+    {
+        std::lock_guard<std::mutex> lock(frame_mutex);
+        worker_stop = true;
+    }
+    frame_cv.notify_all();
+    worker_thread.join(); // A presented frame is still shown before it exits
+}
+
+// Hands the framebuffer to the worker. Only costs a copy of both planes;
+// frames presented while the panel is busy collapse into the newest one.
+void EinkDisplay::present(void) {
+    if (!worker_thread.joinable()) return;
+    {
+        std::lock_guard<std::recursive_mutex> draw(draw_mutex);
+        std::lock_guard<std::mutex> lock(frame_mutex);
+        memcpy(pending_bw, buffer_bw, plane_size);
+        memcpy(pending_red, buffer_red, plane_size);
+        for (size_t i = 0; i < dirty.size(); i++)
+            _addDirty(pending_dirty, dirty[i]);
+        dirty.clear();
+        frame_pending = true;
+    }
+    frame_cv.notify_one();
+}
+
+void EinkDisplay::_workerLoop(void) {
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(frame_mutex);
+            frame_cv.wait(lock, [this] { return frame_pending || worker_stop; });
+            if (!frame_pending) break;
+
+            std::swap(front_bw, pending_bw);
+            std::swap(front_red, pending_red);
+            front_dirty.swap(pending_dirty);
+            pending_dirty.clear();
+            frame_pending = false;
         }
-    } else {
-        // Default to white if null
-        uint8_t* buffer = (uint8_t*)malloc(total_bytes);
-        if (buffer) {
-            memset(buffer, 0xFF, total_bytes);
-            _sendData(buffer, total_bytes);
-            free(buffer);
+
+        // Identical frames don't even wake the controller. The shadow is
+        // only touched by this thread while the worker runs.
+        bool red_changed = red_borrowed && _saveRed(front_red, front_dirty);
+        bool changed = _diffRects(front_bw, red_borrowed ? NULL : front_red, front_dirty, false);
+        if (!changed && !red_changed) continue;
+        _beginSPI();
+        _wake();
+        _sendUploads(front_bw, red_borrowed ? NULL : front_red);
+        _endSPI();
+        if (!_refresh(worker_mode, front_red)) {
+            fprintf(stderr, "Background refresh failed\n");
         }
     }
+}
 
-    // Reset RAM counters for Red layer
-    _writeCommand(0x4E);
-    _writeData(0x00);
-    _writeCommand(0x4F);
-    _writeData(eink_height - 1);
-    _writeData((eink_height - 1) >> 8);
-
-    // Red RAM
-    _writeCommand(0x26);
-    if (image_red) {
-        // Vertical Flip for Red channel too
-        uint8_t* buffer = (uint8_t*)malloc(total_bytes);
-        if (buffer) {
-            for (int y = 0; y < h; y++) {
-                memcpy(buffer + (h - 1 - y) * w, image_red + y * w, w);
-            }
-            _sendData(buffer, total_bytes);
-            free(buffer);
-        } else {
-            _sendData(image_red, total_bytes);
+// Rows are streamed straight from the caller's buffer (which may just as
+// well be an mmap'd file): with Y increment entry mode, image row y lands
+// in RAM row y without any intermediate copy. Only full-width bands of
+// rows that differ from RAM are sent.
+bool EinkDisplay::displayImage(const uint8_t* image_bw, const uint8_t* image_red) {
+    const uint8_t* planes[2] = { image_bw, image_red };
+    const uint8_t ram[2] = { 0x24, 0x26 };
+    const uint8_t blank[2] = { 0xFF, 0x00 }; // White / no red if null
+    bool changed = true;
+
+    _beginSPI();
+
+    if (!arena) {
+        // No shadow or scratch before begin(), send what we have
+        _wake();
+        for (int p = 0; p < 2; p++) {
+            if (!planes[p]) continue;
+            _setRamArea(0, 0, plane_stride - 1, eink_height - 1);
+            _writeCommand(ram[p]);
+            _sendData(planes[p], plane_size);
         }
     } else {
-        // Default to no red if null
-        uint8_t* buffer = (uint8_t*)malloc(total_bytes);
-        if (buffer) {
-            memset(buffer, 0x00, total_bytes);
-            _sendData(buffer, total_bytes);
-            free(buffer);
+        // One plane at a time, so that scratch can stand in for a missing
+        // one. Full-width bands never gather, so it isn't needed for that.
+        changed = false;
+        for (int p = 0; p < 2; p++) {
+            const uint8_t* src = planes[p];
+            if (!src) {
+                memset(scratch, blank[p], plane_size);
+                src = scratch;
+            }
+
+            if (_diffRects(p == 0 ? src : NULL, p == 1 ? src : NULL, _wholePlane(), true)) {
+                _wake();
+                changed = true;
+            }
+            _sendUploads(p == 0 ? src : NULL, p == 1 ? src : NULL);
         }
+        red_borrowed = false;
     }
 
+    // RAM no longer matches the framebuffer
+    _markAllDirty();
+
     _endSPI();
+    return changed;
 }
 
 void EinkDisplay::setWhiteBorder(void) { border = 1; }
 void EinkDisplay::setBlackBorder(void) { border = 0; }
 void EinkDisplay::setRedBorder(void) { border = 2; }
 
-// --- GPIO Helpers (Sysfs) ---
-
-void EinkDisplay::gpio_export(int gpio) {
-    char path[64];
-    snprintf(path, sizeof(path), "/sys/class/gpio/gpio%d/direction", gpio);
-    if (access(path, F_OK) == 0) return; // Already exported
-
-    int fd = open("/sys/class/gpio/export", O_WRONLY);
-    if (fd < 0) return;
-    char buf[16];
-    int len = snprintf(buf, sizeof(buf), "%d", gpio);
-    write(fd, buf, len);
-    close(fd);
-    delay(100); // Wait for udev
-}
-
-void EinkDisplay::gpio_direction_output(int gpio, int value) {
-    char path[64];
-    snprintf(path, sizeof(path), "/sys/class/gpio/gpio%d/direction", gpio);
-    int fd = open(path, O_WRONLY);
-    if (fd < 0) return;
-    write(fd, "out", 3);
-    close(fd);
-    
-    // Set initial value
-    int val_fd = gpio_open_value(gpio, O_WRONLY);
-    if (val_fd >= 0) {
-        gpio_set_value(val_fd, value);
-        close(val_fd);
-    }
-}
+// --- SPI clock ---
 
-void EinkDisplay::gpio_direction_input(int gpio) {
-    char path[64];
-    snprintf(path, sizeof(path), "/sys/class/gpio/gpio%d/direction", gpio);
-    int fd = open(path, O_WRONLY);
-    if (fd < 0) return;
-    write(fd, "in", 2);
-    close(fd);
+void EinkDisplay::setSpiSpeed(uint32_t hz) {
+    spi_speed_hz = hz;
+    bus->setMaxSpeed(hz);
 }
 
-int EinkDisplay::gpio_open_value(int gpio, int flags) {
-    char path[64];
-    snprintf(path, sizeof(path), "/sys/class/gpio/gpio%d/value", gpio);
-    return open(path, flags);
-}
+// Steps the write clock up and checks each rate by writing a pattern to
+// the top of BW RAM and reading it back at SPI_READ_SPEED_HZ. Settles on
+// the last rate that came back intact.
+uint32_t EinkDisplay::probeSpiSpeed(uint32_t max_hz) {
+    static const uint32_t steps[] = {
+        1000000, 2000000, 4000000, 8000000, 10000000, 12000000,
+        16000000, 20000000, 24000000, 32000000, 40000000, 50000000
+    };
+    if (!scratch || max_hz == 0) return spi_speed_hz;
+
+    // Pattern and read-back share the scratch plane
+    uint16_t rows = std::min<uint16_t>(16, eink_height / 2);
+    if (rows == 0) return spi_speed_hz;
+    size_t len = (size_t)plane_stride * rows;
+    uint8_t* pattern = scratch;
+    uint8_t* readback = scratch + len;
+
+    // Without a rate that verifies (e.g. no read-back wired) the clock
+    // stays where it was, within the cap
+    uint32_t previous = std::min(spi_speed_hz, max_hz);
+    uint32_t good = 0, first_tried = 0;
+    size_t n_steps = sizeof(steps) / sizeof(steps[0]);
+    for (size_t i = 0; i <= n_steps; i++) {
+        // The steps below the cap, then the cap itself
+        uint32_t hz = (i < n_steps && steps[i] < max_hz) ? steps[i] : max_hz;
+        if (!first_tried) first_tried = hz;
+        setSpiSpeed(hz);
+
+        uint32_t lcg = hz;
+        for (size_t n = 0; n < len; n++) {
+            lcg = lcg * 1103515245u + 12345u;
+            pattern[n] = lcg >> 16;
+        }
 
-void EinkDisplay::gpio_set_value(int fd, int value) {
-    if (fd < 0) return;
-    write(fd, value ? "1" : "0", 1);
-}
+        _beginSPI();
+        _wake();
+        _setRamArea(0, 0, plane_stride - 1, rows - 1);
+        _writeCommand(0x24);
+        _sendData(pattern, len);
+        bool ok = _readRam(0, 0, 0, plane_stride - 1, rows - 1, readback) &&
+                  memcmp(pattern, readback, len) == 0;
+        _endSPI();
+
+        if (!ok) break;
+        good = hz;
+        if (hz == max_hz) break;
+    }
 
-int EinkDisplay::gpio_get_value(int fd) {
-    if (fd < 0) return 0;
-    char buf[2];
-    lseek(fd, 0, SEEK_SET); // Rewind to read again
-    read(fd, buf, 1);
-    return (buf[0] == '1') ? 1 : 0;
+    if (!good) {
+        fprintf(stderr, "SPI read-back failed at %u Hz, keeping %u Hz\n", first_tried, previous);
+        good = previous;
+    }
+    setSpiSpeed(good);
+
+    // The pattern overwrote RAM
+    shadow_valid &= ~1;
+    _markAllDirty();
+    return good;
 }
 
 // --- SPI Helpers ---
 
-uint8_t EinkDisplay::spi_transfer_byte(uint8_t data) {
-    uint8_t rx = 0;
-    struct spi_ioc_transfer tr;
-    memset(&tr, 0, sizeof(tr));
-    tr.tx_buf = (unsigned long)&data;
-    tr.rx_buf = (unsigned long)&rx;
-    tr.len = 1;
-    tr.speed_hz = 4000000;
-    tr.bits_per_word = 8;
-    
-    if (ioctl(spi_fd, SPI_IOC_MESSAGE(1), &tr) < 0) {
-        // Only print error once to avoid flooding logs
-        static bool error_printed = false;
-        if (!error_printed) {
-            perror("SPI transfer failed");
-            fprintf(stderr, "Error code: %d\n", errno);
-            error_printed = true;
-        }
-    }
-    return rx;
+size_t EinkDisplay::spi_max_message(void) {
+    size_t max = spi_bufsiz ? spi_bufsiz : bus->maxMessageSize();
+    return max ? max : 4096;
 }
 
-void EinkDisplay::spi_transfer(uint8_t* data, int len) {
+void EinkDisplay::spi_transfer(const uint8_t* data, int len, bool keep_cs) {
     struct spi_ioc_transfer tr;
     memset(&tr, 0, sizeof(tr));
     tr.tx_buf = (unsigned long)data;
     tr.rx_buf = 0;
     tr.len = len;
-    tr.speed_hz = 4000000;
+    tr.speed_hz = spi_speed_hz;
     tr.bits_per_word = 8;
-    
-    if (ioctl(spi_fd, SPI_IOC_MESSAGE(1), &tr) < 0) {
-         static bool error_printed = false;
-        if (!error_printed) {
-            perror("SPI transfer failed");
-            fprintf(stderr, "Error code: %d\n", errno);
-            error_printed = true;
-        }
+    tr.cs_change = keep_cs; // On the last transfer: leave CS asserted after the message
+
+    bus->transfer(&tr, 1);
+}
+
+void EinkDisplay::spi_receive(uint8_t* data, int len) {
+    int max_chunk = spi_max_message();
+    for (int offset = 0; offset < len; offset += max_chunk) {
+        struct spi_ioc_transfer tr;
+        memset(&tr, 0, sizeof(tr));
+        tr.tx_buf = 0;
+        tr.rx_buf = (unsigned long)(data + offset);
+        tr.len = (len - offset > max_chunk) ? max_chunk : (len - offset);
+        tr.speed_hz = SPI_READ_SPEED_HZ;
+        tr.bits_per_word = 8;
+        tr.cs_change = (offset + max_chunk < len);
+
+        bus->transfer(&tr, 1);
     }
 }
@@ -25,65 +25,295 @@
 
 #include <cstdint>
 #include <string>
+#include <vector>
+#include <future>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <cmath>
 #include "GFX.h"
+#include "EinkTransport.h"
+#include "RefreshPolicy.h"
 
 #define WHITE                   0
 #define BLACK                   1
 #define RED                     2
 
+#define MAX_DIRTY_RECTS         8
+#define DIFF_BAND_GAP           2 // Unchanged rows bridged inside one upload band
+
+#define DEFAULT_SPI_SPEED_HZ    4000000
+#define SPI_READ_SPEED_HZ       1000000 // RAM/register reads stay slow
+
+#define TEMP_MAX_AGE_MS         60000 // Sensor is read again after this
+#define AUTO_FAST_MIN_TEMP      10    // C, MODE_AUTO defaults
+#define AUTO_PARTIAL_MIN_TEMP   15
+
 class EinkDisplay : public GFX {
   public:
-    // Modified constructor to take device paths/numbers instead of pin numbers
-    EinkDisplay(int einkheight, int einkwidth, const std::string& spi_device, int dc_gpio, int rst_gpio, int cs_gpio, int busy_gpio);
+    enum RefreshMode {
+      MODE_NORMAL, // Vendor "Slow" mode
+      MODE_FAST,   // Vendor "Fast" mode
+      MODE_PARTIAL, // Differential BW update, borrows red RAM for the old frame
+      MODE_AUTO     // One of the above by temperature, see setAutoTemperatures()
+    };
+
+    enum Plane {
+      PLANE_BW,    // 1 = white, 0 = black
+      PLANE_RED    // 1 = red
+    };
+
+    // How drawBitmap() combines source bits with the plane
+    enum RasterOp {
+      ROP_COPY,
+      ROP_OR,
+      ROP_AND,
+      ROP_XOR,
+      ROP_INVERT   // Copy of the inverted source
+    };
+
+    // Custom waveform for one temperature band, replaces the OTP one
+    struct Waveform {
+      int8_t         min_temp;  // Lowest temperature in C the band is for
+      const uint8_t* lut;       // 0x32 payload, panel specific
+      uint16_t       lut_len;
+      uint8_t        gate;      // 0x03 VGH
+      uint8_t        source[3]; // 0x04 VSH1, VSH2, VSL
+      uint8_t        vcom;      // 0x2C
+      uint8_t        eopt;      // 0x3F end option
+    };
+
+    // Modified constructor to take device paths/numbers instead of pin numbers.
+    // With an empty gpio_chip the pins are sysfs GPIO numbers, otherwise they are
+    // line offsets on that character device (e.g. "/dev/gpiochip0").
+    EinkDisplay(int einkheight, int einkwidth, const std::string& spi_device, int dc_gpio, int rst_gpio, int cs_gpio, int busy_gpio,
+                const std::string& gpio_chip = "", uint32_t spi_speed_hz = DEFAULT_SPI_SPEED_HZ);
+    // Drive the panel through a caller-owned transport, e.g. Ssd1683Sim
+    EinkDisplay(int einkheight, int einkwidth, EinkTransport& transport);
     ~EinkDisplay();
 
     bool         begin();
-    void         display(void);
-    void         displayNormal(void); // Vendor "Slow" mode
-    void         displayFast(void);   // Vendor "Fast" mode
-    void         prepare();
+    bool         display(void);
+    bool         displayNormal(void); // Vendor "Slow" mode
+    bool         displayFast(void);   // Vendor "Fast" mode
+    bool         displayPartial(void); // Only flips changed pixels, BW only, see setRefreshPolicy()
+    std::shared_future<bool> displayAsync(RefreshMode mode = MODE_NORMAL); // Ready when BUSY drops
+    void         prepare();           // Full init, uploads and refreshes also do it when the controller sleeps
     void         clearDisplay(void);
     void         fillBlack(void);
-    void         displayImage(const uint8_t* image_bw, const uint8_t* image_red); // New method for full screen image
+    // Both upload only what differs from the last RAM contents and return
+    // false if nothing did, in which case there is nothing to refresh
+    bool         displayImage(const uint8_t* image_bw, const uint8_t* image_red); // New method for full screen image
+    bool         flush(void);         // Upload changed framebuffer regions to controller RAM
+
+    // Double buffering: a worker thread owns the controller, producers draw
+    // into the framebuffer and present() it without waiting on SPI or BUSY.
+    // Don't call flush() or display*() directly while the worker runs.
+    // Producers on several threads hold drawLock() around their drawing,
+    // cursor and text settings included. present() takes it itself, so it
+    // works with or without the lock held.
+    bool         startWorker(RefreshMode mode = MODE_NORMAL);
+    void         stopWorker(void);
+    void         present(void);
+    std::recursive_mutex& drawLock(void) { return draw_mutex; }
     void         setWhiteBorder(void);
     void         setBlackBorder(void);
     void         setRedBorder(void);
     void         drawPixel(int16_t x, int16_t y, uint16_t color) override;
     void         drawFastHLine(int16_t x, int16_t y, int16_t w, uint16_t color) override;
     void         drawFastVLine(int16_t x, int16_t y, int16_t h, uint16_t color) override;
+    void         fillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color) override;
+    void         drawChar(int16_t x, int16_t y, char c, uint16_t color, uint16_t bg, uint8_t size) override;
+    void         drawBitmap(int16_t x, int16_t y, int16_t w, int16_t h, const uint8_t* data, Plane plane, RasterOp rop = ROP_COPY); // Packed 1bpp rows, MSB first
+    void         setBusyTimeout(int ms) { busy_timeout_ms = ms; } // <= 0 waits forever
+    int          lastBusyTime(void) const { return last_busy_ms; } // Length of the last BUSY period in ms
+    void         setSpiSpeed(uint32_t hz);
+    uint32_t     spiSpeed(void) const { return spi_speed_hz; }
+    uint32_t     probeSpiSpeed(uint32_t max_hz = 20000000); // Fastest clock that reads back intact, needs begin()
+    void         setMaxTransferSize(size_t bytes) { spi_bufsiz = bytes; } // Overrides spidev bufsiz, 0 = ask the transport
+    void         setSettleTime(int ms) { settle_ms = ms; } // Extra wait after BUSY drops, 0 by default
+    // Deep sleep after this long without controller traffic, so bursts of
+    // updates skip the reset and init. 0 (the default) sleeps straight
+    // after every refresh, < 0 never. RAM is retained either way.
+    void         setSleepTimeout(int ms);
+    bool         isAsleep(void) const { return asleep; }
+    int          lastRefreshTime(void) const { return last_refresh_ms; } // Duration of the last refresh in ms
+    RefreshMode  lastRefreshMode(void) const { return last_mode; } // What the last refresh actually ran as
+    // Caller-owned ghosting budget: MODE_PARTIAL turns into a full refresh
+    // whenever the policy says so. NULL (the default) never forces one.
+    void         setRefreshPolicy(RefreshPolicy* p) { policy = p; }
+    // Caller-owned bands sorted by min_temp, NULL goes back to OTP. Below
+    // the first band the first one is used. A band's LUT and voltages
+    // are only sent again after the band changes or the controller lost them.
+    void         setWaveforms(RefreshMode mode, const Waveform* bands, int count);
+    float        readTemperature(void); // Internal sensor in C, wakes the controller, NAN if it never answered
+    float        temperature(void) const { return temp_valid ? temp_raw / 16.0f : NAN; } // Last reading
+    // MODE_AUTO refreshes normally below fast_min_c or without a reading,
+    // fast below partial_min_c and partially from there up, unless red RAM
+    // has red in it.
+    void         setAutoTemperatures(int fast_min_c, int partial_min_c) { auto_fast_min = fast_min_c; auto_partial_min = partial_min_c; }
     
     int eink_height, eink_width;
 
   private:
-    void _writeCommand(uint8_t command);
-    void _writeData(uint8_t data);
+    EinkDisplay(int einkheight, int einkwidth, EinkTransport* transport, bool owns_transport);
+
+    // Region of RAM touched since the last flush(). x in bytes, inclusive.
+    struct DirtyRect {
+      uint16_t x0, y0, x1, y1;
+    };
+
+    // Part of RAM that differs from the planes being uploaded
+    struct Upload {
+      DirtyRect r;
+      uint8_t planes; // 1 = BW, 2 = red
+    };
+
+    // Run of queued bytes sharing one DC level
+    struct BatchRun {
+      size_t offset, len;
+      uint8_t dc;
+    };
+
+    void _writeCommand(uint8_t command); // Queued until _submitBatch()
+    void _writeData(uint8_t data);       // Queued until _submitBatch()
+    void _queueByte(uint8_t dc, uint8_t value);
+    void _submitBatch(void);
+    void _setDC(int value);
     void _sendData(const uint8_t* data, size_t len); // New helper for bulk transfer
-    uint8_t _readPixel(int16_t x, int16_t y, uint16_t color);
-    void _waitWhileBusy();
+    void _setRamArea(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1); // x in bytes, Y increment
+    void _markDirty(int16_t x0, int16_t y0, int16_t x1, int16_t y1); // Pixel coordinates
+    void _fillPhysical(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint16_t color); // Unrotated, inclusive
+    void _rotate(int16_t& x, int16_t& y) const; // Rotated to panel coordinates
+    void _buildGlyphCache(void);
+    void _addDirty(std::vector<DirtyRect>& list, DirtyRect r);
+    void _markAllDirty(void);
+    std::vector<DirtyRect>& _wholePlane(void); // Reuses whole_plane, no allocation
+    void _uploadRect(const DirtyRect& r, const uint8_t* plane_bw, const uint8_t* plane_red, uint8_t planes = 3);
+    bool _diffRects(const uint8_t* plane_bw, const uint8_t* plane_red, std::vector<DirtyRect>& rects, bool full_rows); // Fills uploads
+    void _sendUploads(const uint8_t* plane_bw, const uint8_t* plane_red);
+    bool _flushPlanes(const uint8_t* plane_bw, const uint8_t* plane_red, std::vector<DirtyRect>& rects);
+    bool _saveRed(const uint8_t* plane_red, const std::vector<DirtyRect>& rects); // While red RAM is borrowed, true if saved_red changed
+    void _workerLoop(void);
+    bool _allocArena(void);
+    bool _readRam(uint8_t plane, uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, uint8_t* out); // 0 = BW, 1 = RED
+    bool _waitWhileBusy(); // false on timeout
+    bool _refresh(RefreshMode mode, const uint8_t* plane_red);
+    void _startRefresh(RefreshMode mode, const uint8_t* plane_red); // plane_red restores borrowed red RAM
+    bool _finishRefresh(void);
     void _beginSPI(void);
     void _endSPI(void);
+    void _init(void); // Caller owns the bus
+    void _wake(void); // Caller owns the bus
+    void _sleepLoop(void);
+    bool _readTemperature(void); // Caller owns the bus
+    void _updateTemperature(bool force); // Caller owns the bus
+    RefreshMode _autoMode(const uint8_t* plane_red);
+    const Waveform* _selectWaveform(RefreshMode mode);
+    void _loadWaveform(const Waveform* w);
     
-    // Linux specific members
-    int spi_fd;
-    std::string spi_dev_path;
-    int dc_gpio, cs_gpio, busy_gpio, rst_gpio;
-    
-    // File descriptors for GPIO values to improve performance
-    int dc_fd, cs_fd, busy_fd, rst_fd;
+    EinkTransport* bus;
+    bool owns_bus;
+    uint32_t spi_speed_hz; // Clock for every write transfer
+    size_t   spi_bufsiz;   // Bytes per SPI message, 0 = transport's maxMessageSize()
     
     uint8_t border = 1;
 
-    // GPIO helpers
-    void gpio_export(int gpio);
-    void gpio_direction_output(int gpio, int value);
-    void gpio_direction_input(int gpio);
-    void gpio_set_value(int fd, int value); // Changed to take fd
-    int  gpio_get_value(int fd); // Changed to take fd
-    int  gpio_open_value(int gpio, int flags); // New helper
-    
+    int  busy_timeout_ms;
+    int  last_busy_ms;
+    int  settle_ms;
+    int  last_refresh_ms;
+    RefreshMode last_mode;
+    RefreshPolicy* policy;
+
+    // Custom waveforms by RefreshMode and what the LUT register holds,
+    // NULL after a reset or an OTP load
+    const Waveform* waveforms[3];
+    int             waveform_count[3];
+    const Waveform* loaded_waveform;
+
+    std::atomic<int16_t> temp_raw; // Last sensor reading in 1/16 C
+    std::atomic<bool> temp_valid; // No reading until the sensor first answers
+    std::chrono::steady_clock::time_point temp_time;
+    int  auto_fast_min, auto_partial_min;
+
+    // Controller ownership, see _beginSPI()
+    std::mutex io_mutex;
+    std::condition_variable io_cv;
+    bool io_owned;
+    std::shared_future<bool> refresh_pending;
+
+    // Idle deep sleep, all guarded by io_mutex
+    int  sleep_timeout_ms;
+    bool sleep_stop;
+    bool sleep_after_refresh; // sleep_timeout_ms == 0 as of _startRefresh(), owned with the bus
+    std::chrono::steady_clock::time_point last_io; // When the bus was last released
+    std::thread sleep_thread;
+
+    // Page-aligned arena allocated by begin(), one page-rounded plane per slot
+    enum { ARENA_SLOTS = 9 };
+    uint8_t* arena;
+    uint8_t* scratch;      // Gather buffer for partial-width uploads and blank planes
+
+    // What BW and red RAM hold, so unchanged data never goes over SPI.
+    // A plane's shadow is valid once the whole plane has been written.
+    uint8_t* shadow_bw;
+    uint8_t* shadow_red;
+    uint8_t shadow_valid; // 1 = BW, 2 = red
+
+    // BW frame currently on the glass, which MODE_PARTIAL writes to red
+    // RAM as the previous frame. Red RAM is borrowed until the next full
+    // refresh puts saved_red back or displayImage() replaces it. Flushes
+    // meanwhile update saved_red instead of red RAM.
+    uint8_t* displayed_bw;
+    uint8_t* saved_red;
+    bool displayed_valid;
+    bool red_borrowed;
+    std::vector<Upload> uploads;
+    std::atomic<bool> asleep; // Controller needs _init() before the next upload, read by isAsleep()
+
+    // Double buffering: pending is the last presented frame, front is
+    // what the worker is uploading. Both guarded by frame_mutex, both in the arena.
+    uint8_t* pending_bw;
+    uint8_t* pending_red;
+    uint8_t* front_bw;
+    uint8_t* front_red;
+    std::vector<DirtyRect> pending_dirty, front_dirty;
+    std::mutex frame_mutex;
+    std::recursive_mutex draw_mutex; // Framebuffer and dirty list, taken before frame_mutex
+    std::condition_variable frame_cv;
+    bool frame_pending, worker_stop;
+    RefreshMode worker_mode;
+    std::thread worker_thread;
+
+    // Host-side framebuffer, same layout as controller RAM (row-major, MSB first).
+    // BW plane: 1 = white, 0 = black. Red plane: 1 = red.
+    uint8_t* buffer_bw;
+    uint8_t* buffer_red;
+    uint16_t plane_stride; // bytes per row
+    size_t   plane_size;   // bytes per plane
+
+    std::vector<DirtyRect> dirty;
+    std::vector<DirtyRect> whole_plane; // Single full-plane rect for _diffRects()
+
+    // Command/parameter bytes queued between _beginSPI() and _endSPI()
+    std::vector<uint8_t> batch_buf;
+    std::vector<BatchRun> batch_runs;
+    int dc_level; // Last value written to DC, -1 if unknown
+
+    // Every glyph of glyph_font pre-shifted to the 8 bit offsets within a
+    // byte: [glyph][shift][row][glyph_stride], rows cover the whole cell
+    const GFXfont*       glyph_font;
+    uint16_t             glyph_stride;
+    std::vector<uint8_t> glyph_cache;
+    std::vector<uint8_t> glyph_box;   // Cell mask per shift, [shift][glyph_stride]
+
     // SPI helpers
-    void spi_transfer(uint8_t* data, int len);
-    uint8_t spi_transfer_byte(uint8_t data);
+    void spi_transfer(const uint8_t* data, int len, bool keep_cs = false);
+    size_t spi_max_message(void);
+    void spi_receive(uint8_t* data, int len); // At SPI_READ_SPEED_HZ
 };
 
 #endif // _EinkDisplay_
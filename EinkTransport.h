@@ -0,0 +1,65 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (C) 2025 Lese
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _EinkTransport_H_
+#define _EinkTransport_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <chrono>
+#include <linux/spi/spidev.h>
+
+// Wire-level access to the panel: the SPI bus plus the DC, RST, CS and
+// BUSY lines. EinkDisplay only talks to the controller through this, so
+// the Linux spidev/GPIO implementation can be swapped for a simulator.
+class EinkTransport {
+  public:
+    virtual ~EinkTransport() {}
+
+    virtual bool begin() = 0;
+
+    virtual void setReset(int value) = 0;
+    virtual void setDC(int value) = 0;
+    virtual void setCS(int value) = 0;   // No-op when CS is handled by spidev
+    virtual int  getBusy() = 0;
+
+    // Sleeps until BUSY has a falling edge or timeout_ms expires (-1 waits forever).
+    // Returns >0 on an edge, 0 on timeout, <0 if edge events are not available.
+    virtual int  waitBusyEdge(int timeout_ms) = 0;
+
+    // Clock BUSY periods are timed against, in ms. A simulator skipping
+    // BUSY on a virtual clock returns that instead of wall time.
+    virtual double nowMs() {
+      return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // Default clock for transfers that don't set speed_hz
+    virtual bool setMaxSpeed(uint32_t hz) = 0;
+
+    // Largest number of bytes a single message may carry (spidev bufsiz)
+    virtual size_t maxMessageSize() = 0;
+
+    // Submits n transfers as a single SPI message, like SPI_IOC_MESSAGE(n)
+    virtual bool transfer(struct spi_ioc_transfer* tr, unsigned n) = 0;
+};
+
+#endif // _EinkTransport_H_
@@ -0,0 +1,124 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (C) 2025 Lese
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "GFXFont.h"
+
+// 7 rows per glyph, 5 pixels in the top bits of each row
+static const uint8_t font5x7_bitmap[] = {
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // 0x20 space
+  0x20, 0x20, 0x20, 0x20, 0x20, 0x00, 0x20, // 0x21 !
+  0x50, 0x50, 0x50, 0x00, 0x00, 0x00, 0x00, // 0x22 "
+  0x50, 0x50, 0xF8, 0x50, 0xF8, 0x50, 0x50, // 0x23 #
+  0x20, 0x78, 0xA0, 0x70, 0x28, 0xF0, 0x20, // 0x24 $
+  0xC0, 0xC8, 0x10, 0x20, 0x40, 0x98, 0x18, // 0x25 %
+  0x60, 0x90, 0xA0, 0x40, 0xA8, 0x90, 0x68, // 0x26 &
+  0x20, 0x20, 0x40, 0x00, 0x00, 0x00, 0x00, // 0x27 quote
+  0x10, 0x20, 0x40, 0x40, 0x40, 0x20, 0x10, // 0x28 (
+  0x40, 0x20, 0x10, 0x10, 0x10, 0x20, 0x40, // 0x29 )
+  0x00, 0x20, 0xA8, 0x70, 0xA8, 0x20, 0x00, // 0x2A *
+  0x00, 0x20, 0x20, 0xF8, 0x20, 0x20, 0x00, // 0x2B +
+  0x00, 0x00, 0x00, 0x00, 0x60, 0x20, 0x40, // 0x2C ,
+  0x00, 0x00, 0x00, 0xF8, 0x00, 0x00, 0x00, // 0x2D -
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x60, 0x60, // 0x2E .
+  0x00, 0x08, 0x10, 0x20, 0x40, 0x80, 0x00, // 0x2F /
+  0x70, 0x88, 0x98, 0xA8, 0xC8, 0x88, 0x70, // 0x30 0
+  0x20, 0x60, 0x20, 0x20, 0x20, 0x20, 0x70, // 0x31 1
+  0x70, 0x88, 0x08, 0x10, 0x20, 0x40, 0xF8, // 0x32 2
+  0xF8, 0x10, 0x20, 0x10, 0x08, 0x88, 0x70, // 0x33 3
+  0x10, 0x30, 0x50, 0x90, 0xF8, 0x10, 0x10, // 0x34 4
+  0xF8, 0x80, 0xF0, 0x08, 0x08, 0x88, 0x70, // 0x35 5
+  0x30, 0x40, 0x80, 0xF0, 0x88, 0x88, 0x70, // 0x36 6
+  0xF8, 0x08, 0x10, 0x20, 0x40, 0x40, 0x40, // 0x37 7
+  0x70, 0x88, 0x88, 0x70, 0x88, 0x88, 0x70, // 0x38 8
+  0x70, 0x88, 0x88, 0x78, 0x08, 0x10, 0x60, // 0x39 9
+  0x00, 0x60, 0x60, 0x00, 0x60, 0x60, 0x00, // 0x3A :
+  0x00, 0x60, 0x60, 0x00, 0x60, 0x20, 0x40, // 0x3B ;
+  0x10, 0x20, 0x40, 0x80, 0x40, 0x20, 0x10, // 0x3C <
+  0x00, 0x00, 0xF8, 0x00, 0xF8, 0x00, 0x00, // 0x3D =
+  0x40, 0x20, 0x10, 0x08, 0x10, 0x20, 0x40, // 0x3E >
+  0x70, 0x88, 0x08, 0x10, 0x20, 0x00, 0x20, // 0x3F ?
+  0x70, 0x88, 0x08, 0x68, 0xA8, 0xA8, 0x70, // 0x40 @
+  0x70, 0x88, 0x88, 0xF8, 0x88, 0x88, 0x88, // 0x41 A
+  0xF0, 0x88, 0x88, 0xF0, 0x88, 0x88, 0xF0, // 0x42 B
+  0x70, 0x88, 0x80, 0x80, 0x80, 0x88, 0x70, // 0x43 C
+  0xE0, 0x90, 0x88, 0x88, 0x88, 0x90, 0xE0, // 0x44 D
+  0xF8, 0x80, 0x80, 0xF0, 0x80, 0x80, 0xF8, // 0x45 E
+  0xF8, 0x80, 0x80, 0xF0, 0x80, 0x80, 0x80, // 0x46 F
+  0x70, 0x88, 0x80, 0xB8, 0x88, 0x88, 0x78, // 0x47 G
+  0x88, 0x88, 0x88, 0xF8, 0x88, 0x88, 0x88, // 0x48 H
+  0x70, 0x20, 0x20, 0x20, 0x20, 0x20, 0x70, // 0x49 I
+  0x38, 0x10, 0x10, 0x10, 0x10, 0x90, 0x60, // 0x4A J
+  0x88, 0x90, 0xA0, 0xC0, 0xA0, 0x90, 0x88, // 0x4B K
+  0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0xF8, // 0x4C L
+  0x88, 0xD8, 0xA8, 0xA8, 0x88, 0x88, 0x88, // 0x4D M
+  0x88, 0x88, 0xC8, 0xA8, 0x98, 0x88, 0x88, // 0x4E N
+  0x70, 0x88, 0x88, 0x88, 0x88, 0x88, 0x70, // 0x4F O
+  0xF0, 0x88, 0x88, 0xF0, 0x80, 0x80, 0x80, // 0x50 P
+  0x70, 0x88, 0x88, 0x88, 0xA8, 0x90, 0x68, // 0x51 Q
+  0xF0, 0x88, 0x88, 0xF0, 0xA0, 0x90, 0x88, // 0x52 R
+  0x78, 0x80, 0x80, 0x70, 0x08, 0x08, 0xF0, // 0x53 S
+  0xF8, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, // 0x54 T
+  0x88, 0x88, 0x88, 0x88, 0x88, 0x88, 0x70, // 0x55 U
+  0x88, 0x88, 0x88, 0x88, 0x88, 0x50, 0x20, // 0x56 V
+  0x88, 0x88, 0x88, 0xA8, 0xA8, 0xA8, 0x50, // 0x57 W
+  0x88, 0x88, 0x50, 0x20, 0x50, 0x88, 0x88, // 0x58 X
+  0x88, 0x88, 0x88, 0x50, 0x20, 0x20, 0x20, // 0x59 Y
+  0xF8, 0x08, 0x10, 0x20, 0x40, 0x80, 0xF8, // 0x5A Z
+  0x70, 0x40, 0x40, 0x40, 0x40, 0x40, 0x70, // 0x5B [
+  0x00, 0x80, 0x40, 0x20, 0x10, 0x08, 0x00, // 0x5C backslash
+  0x70, 0x10, 0x10, 0x10, 0x10, 0x10, 0x70, // 0x5D ]
+  0x20, 0x50, 0x88, 0x00, 0x00, 0x00, 0x00, // 0x5E ^
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xF8, // 0x5F _
+  0x40, 0x20, 0x10, 0x00, 0x00, 0x00, 0x00, // 0x60 `
+  0x00, 0x00, 0x70, 0x08, 0x78, 0x88, 0x78, // 0x61 a
+  0x80, 0x80, 0xB0, 0xC8, 0x88, 0x88, 0xF0, // 0x62 b
+  0x00, 0x00, 0x70, 0x80, 0x80, 0x88, 0x70, // 0x63 c
+  0x08, 0x08, 0x68, 0x98, 0x88, 0x88, 0x78, // 0x64 d
+  0x00, 0x00, 0x70, 0x88, 0xF8, 0x80, 0x70, // 0x65 e
+  0x30, 0x48, 0x40, 0xE0, 0x40, 0x40, 0x40, // 0x66 f
+  0x00, 0x78, 0x88, 0x88, 0x78, 0x08, 0x70, // 0x67 g
+  0x80, 0x80, 0xB0, 0xC8, 0x88, 0x88, 0x88, // 0x68 h
+  0x20, 0x00, 0x60, 0x20, 0x20, 0x20, 0x70, // 0x69 i
+  0x10, 0x00, 0x30, 0x10, 0x10, 0x90, 0x60, // 0x6A j
+  0x80, 0x80, 0x90, 0xA0, 0xC0, 0xA0, 0x90, // 0x6B k
+  0x60, 0x20, 0x20, 0x20, 0x20, 0x20, 0x70, // 0x6C l
+  0x00, 0x00, 0xD0, 0xA8, 0xA8, 0x88, 0x88, // 0x6D m
+  0x00, 0x00, 0xB0, 0xC8, 0x88, 0x88, 0x88, // 0x6E n
+  0x00, 0x00, 0x70, 0x88, 0x88, 0x88, 0x70, // 0x6F o
+  0x00, 0x00, 0xF0, 0x88, 0xF0, 0x80, 0x80, // 0x70 p
+  0x00, 0x00, 0x68, 0x98, 0x78, 0x08, 0x08, // 0x71 q
+  0x00, 0x00, 0xB0, 0xC8, 0x80, 0x80, 0x80, // 0x72 r
+  0x00, 0x00, 0x70, 0x80, 0x70, 0x08, 0xF0, // 0x73 s
+  0x40, 0x40, 0xE0, 0x40, 0x40, 0x48, 0x30, // 0x74 t
+  0x00, 0x00, 0x88, 0x88, 0x88, 0x98, 0x68, // 0x75 u
+  0x00, 0x00, 0x88, 0x88, 0x88, 0x50, 0x20, // 0x76 v
+  0x00, 0x00, 0x88, 0x88, 0xA8, 0xA8, 0x50, // 0x77 w
+  0x00, 0x00, 0x88, 0x50, 0x20, 0x50, 0x88, // 0x78 x
+  0x00, 0x00, 0x88, 0x88, 0x78, 0x08, 0x70, // 0x79 y
+  0x00, 0x00, 0xF8, 0x10, 0x20, 0x40, 0xF8, // 0x7A z
+  0x10, 0x20, 0x20, 0x40, 0x20, 0x20, 0x10, // 0x7B {
+  0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, // 0x7C |
+  0x40, 0x20, 0x20, 0x10, 0x20, 0x20, 0x40, // 0x7D }
+  0x00, 0x00, 0x40, 0xA8, 0x10, 0x00, 0x00, // 0x7E ~
+};
+
+const GFXfont Font5x7 = { font5x7_bitmap, 0x20, 0x7E, 5, 7, 6, 8 };
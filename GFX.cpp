@@ -0,0 +1,336 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (C) 2025 Lese
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "GFX.h"
+
+#define gfx_swap(a, b) \
+  do { int16_t t = a; a = b; b = t; } while (0)
+
+// Bresenham, but pixels that share a row (or a column for steep lines) are
+// emitted as one fast line instead of one drawPixel each
+void GFX::drawLine(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint16_t color) {
+  if (y0 == y1) {
+    if (x1 < x0) gfx_swap(x0, x1);
+    drawFastHLine(x0, y0, x1 - x0 + 1, color);
+    return;
+  }
+  if (x0 == x1) {
+    if (y1 < y0) gfx_swap(y0, y1);
+    drawFastVLine(x0, y0, y1 - y0 + 1, color);
+    return;
+  }
+
+  bool steep = abs(y1 - y0) > abs(x1 - x0);
+  if (steep) {
+    gfx_swap(x0, y0);
+    gfx_swap(x1, y1);
+  }
+  if (x0 > x1) {
+    gfx_swap(x0, x1);
+    gfx_swap(y0, y1);
+  }
+
+  int dx = x1 - x0;
+  int dy = abs(y1 - y0);
+  int err = dx / 2;
+  int16_t ystep = (y0 < y1) ? 1 : -1;
+  int16_t run_start = x0;
+
+  for (int16_t x = x0; x <= x1; x++) {
+    err -= dy;
+    if (err < 0 || x == x1) {
+      // End of a run at this y (or the end of the line)
+      if (steep) drawFastVLine(y0, run_start, x - run_start + 1, color);
+      else       drawFastHLine(run_start, y0, x - run_start + 1, color);
+      y0 += ystep;
+      err += dx;
+      run_start = x + 1;
+    }
+  }
+}
+
+void GFX::drawRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color) {
+  if (w <= 0 || h <= 0) return;
+  drawFastHLine(x, y, w, color);
+  drawFastHLine(x, y + h - 1, w, color);
+  drawFastVLine(x, y, h, color);
+  drawFastVLine(x + w - 1, y, h, color);
+}
+
+void GFX::drawCircle(int16_t x0, int16_t y0, int16_t r, uint16_t color) {
+  if (r < 0) return;
+  drawPixel(x0, y0 + r, color);
+  drawPixel(x0, y0 - r, color);
+  drawPixel(x0 + r, y0, color);
+  drawPixel(x0 - r, y0, color);
+  drawCircleHelper(x0, y0, r, 0xF, color);
+}
+
+// Midpoint circle outline, corners: 1 top left, 2 top right, 4 bottom right, 8 bottom left
+void GFX::drawCircleHelper(int16_t x0, int16_t y0, int16_t r, uint8_t corners, uint16_t color) {
+  int16_t f = 1 - r;
+  int16_t ddF_x = 1;
+  int16_t ddF_y = -2 * r;
+  int16_t x = 0;
+  int16_t y = r;
+
+  while (x < y) {
+    if (f >= 0) {
+      y--;
+      ddF_y += 2;
+      f += ddF_y;
+    }
+    x++;
+    ddF_x += 2;
+    f += ddF_x;
+    if (corners & 0x4) {
+      drawPixel(x0 + x, y0 + y, color);
+      drawPixel(x0 + y, y0 + x, color);
+    }
+    if (corners & 0x2) {
+      drawPixel(x0 + x, y0 - y, color);
+      drawPixel(x0 + y, y0 - x, color);
+    }
+    if (corners & 0x8) {
+      drawPixel(x0 - y, y0 + x, color);
+      drawPixel(x0 - x, y0 + y, color);
+    }
+    if (corners & 0x1) {
+      drawPixel(x0 - y, y0 - x, color);
+      drawPixel(x0 - x, y0 - y, color);
+    }
+  }
+}
+
+void GFX::fillCircle(int16_t x0, int16_t y0, int16_t r, uint16_t color) {
+  if (r < 0) return;
+  drawFastHLine(x0 - r, y0, 2 * r + 1, color);
+  fillCircleHelper(x0, y0, r, 3, 0, color);
+}
+
+// Filled half circles as one span per row, halves: 1 top, 2 bottom.
+// delta stretches every span to the right, fillRoundRect uses it for
+// the straight part between two corners.
+void GFX::fillCircleHelper(int16_t x0, int16_t y0, int16_t r, uint8_t halves, int16_t delta, uint16_t color) {
+  int16_t f = 1 - r;
+  int16_t ddF_x = 1;
+  int16_t ddF_y = -2 * r;
+  int16_t x = 0;
+  int16_t y = r;
+  int16_t px = x;
+  int16_t py = y;
+
+  delta++; // Spans are 2 * half width + 1 pixels
+
+  while (x < y) {
+    if (f >= 0) {
+      y--;
+      ddF_y += 2;
+      f += ddF_y;
+    }
+    x++;
+    ddF_x += 2;
+    f += ddF_x;
+    // Rows x away from the centre are y wide, but only draw each row once
+    if (x < (y + 1)) {
+      if (halves & 1) drawFastHLine(x0 - y, y0 - x, 2 * y + delta, color);
+      if (halves & 2) drawFastHLine(x0 - y, y0 + x, 2 * y + delta, color);
+    }
+    if (y != py) {
+      if (halves & 1) drawFastHLine(x0 - px, y0 - py, 2 * px + delta, color);
+      if (halves & 2) drawFastHLine(x0 - px, y0 + py, 2 * px + delta, color);
+      py = y;
+    }
+    px = x;
+  }
+}
+
+void GFX::drawTriangle(int16_t x0, int16_t y0, int16_t x1, int16_t y1, int16_t x2, int16_t y2, uint16_t color) {
+  drawLine(x0, y0, x1, y1, color);
+  drawLine(x1, y1, x2, y2, color);
+  drawLine(x2, y2, x0, y0, color);
+}
+
+// Scanline fill, one span per row between the long edge and the two short ones
+void GFX::fillTriangle(int16_t x0, int16_t y0, int16_t x1, int16_t y1, int16_t x2, int16_t y2, uint16_t color) {
+  // Sort by y so that y0 <= y1 <= y2
+  if (y0 > y1) {
+    gfx_swap(y0, y1);
+    gfx_swap(x0, x1);
+  }
+  if (y1 > y2) {
+    gfx_swap(y2, y1);
+    gfx_swap(x2, x1);
+  }
+  if (y0 > y1) {
+    gfx_swap(y0, y1);
+    gfx_swap(x0, x1);
+  }
+
+  if (y0 == y2) { // All on one row
+    int16_t a = x0, b = x0;
+    if (x1 < a) a = x1; else if (x1 > b) b = x1;
+    if (x2 < a) a = x2; else if (x2 > b) b = x2;
+    drawFastHLine(a, y0, b - a + 1, color);
+    return;
+  }
+
+  int32_t dx01 = x1 - x0, dy01 = y1 - y0;
+  int32_t dx02 = x2 - x0, dy02 = y2 - y0;
+  int32_t dx12 = x2 - x1, dy12 = y2 - y1;
+  int32_t sa = 0, sb = 0;
+  int16_t a, b, y, last;
+
+  // The upper part runs y0..y1, including y1 unless the bottom edge is
+  // flat, in which case the lower loop below handles it
+  if (y1 == y2) last = y1;
+  else          last = y1 - 1;
+
+  for (y = y0; y <= last; y++) {
+    a = x0 + sa / dy01;
+    b = x0 + sb / dy02;
+    sa += dx01;
+    sb += dx02;
+    if (a > b) gfx_swap(a, b);
+    drawFastHLine(a, y, b - a + 1, color);
+  }
+
+  // The lower part runs y1..y2 (skipped if y1 == y2)
+  sa = dx12 * (y - y1);
+  sb = dx02 * (y - y0);
+  for (; y <= y2; y++) {
+    a = x1 + sa / dy12;
+    b = x0 + sb / dy02;
+    sa += dx12;
+    sb += dx02;
+    if (a > b) gfx_swap(a, b);
+    drawFastHLine(a, y, b - a + 1, color);
+  }
+}
+
+void GFX::drawRoundRect(int16_t x, int16_t y, int16_t w, int16_t h, int16_t r, uint16_t color) {
+  if (w <= 0 || h <= 0) return;
+  int16_t max_r = ((w < h) ? w : h) / 2;
+  if (r > max_r) r = max_r;
+  if (r < 0) r = 0;
+
+  drawFastHLine(x + r, y, w - 2 * r, color);
+  drawFastHLine(x + r, y + h - 1, w - 2 * r, color);
+  drawFastVLine(x, y + r, h - 2 * r, color);
+  drawFastVLine(x + w - 1, y + r, h - 2 * r, color);
+  drawCircleHelper(x + r, y + r, r, 1, color);
+  drawCircleHelper(x + w - r - 1, y + r, r, 2, color);
+  drawCircleHelper(x + w - r - 1, y + h - r - 1, r, 4, color);
+  drawCircleHelper(x + r, y + h - r - 1, r, 8, color);
+}
+
+void GFX::fillRoundRect(int16_t x, int16_t y, int16_t w, int16_t h, int16_t r, uint16_t color) {
+  if (w <= 0 || h <= 0) return;
+  int16_t max_r = ((w < h) ? w : h) / 2;
+  if (r > max_r) r = max_r;
+  if (r < 0) r = 0;
+
+  // Straight middle band, then the two rounded ends as stretched half circles
+  fillRect(x, y + r, w, h - 2 * r, color);
+  fillCircleHelper(x + r, y + r, r, 1, w - 2 * r - 1, color);
+  fillCircleHelper(x + r, y + h - r - 1, r, 2, w - 2 * r - 1, color);
+}
+
+// Generic glyph drawing: each run of set pixels in a glyph row is one
+// fillRect, so a scaled glyph still costs only a few spans per row
+void GFX::drawChar(int16_t x, int16_t y, char c, uint16_t color, uint16_t bg, uint8_t size) {
+  uint8_t ch = (uint8_t)c;
+  if (ch < font->first || ch > font->last) ch = '?';
+  if (ch < font->first || ch > font->last) return;
+
+  int16_t row_bytes = (font->width + 7) / 8;
+  const uint8_t* glyph = font->bitmap + (size_t)(ch - font->first) * font->height * row_bytes;
+
+  if (bg != color) {
+    fillRect(x, y, font->advance * size, font->line_height * size, bg);
+  }
+
+  for (int16_t row = 0; row < font->height; row++) {
+    const uint8_t* bits = glyph + row * row_bytes;
+    int16_t run = -1;
+    for (int16_t col = 0; col <= font->width; col++) {
+      bool on = (col < font->width) && (bits[col / 8] & (0x80 >> (col % 8)));
+      if (on && run < 0) {
+        run = col;
+      } else if (!on && run >= 0) {
+        fillRect(x + run * size, y + row * size, (col - run) * size, size, color);
+        run = -1;
+      }
+    }
+  }
+}
+
+size_t GFX::write(char c) {
+  if (c == '\n') {
+    cursor_x = 0;
+    cursor_y += font->line_height * text_size;
+  } else if (c != '\r') {
+    if (text_wrap && (cursor_x + font->advance * text_size > _width)) {
+      cursor_x = 0;
+      cursor_y += font->line_height * text_size;
+    }
+    drawChar(cursor_x, cursor_y, c, text_color, text_bg, text_size);
+    cursor_x += font->advance * text_size;
+  }
+  return 1;
+}
+
+size_t GFX::print(const char* s) {
+  size_t n = 0;
+  while (s && *s) n += write(*s++);
+  return n;
+}
+
+// Box print(s) would cover when started at x, y, wrapping like write() does
+void GFX::getTextBounds(const char* s, int16_t x, int16_t y, int16_t* x1, int16_t* y1, uint16_t* w, uint16_t* h) {
+  int16_t cell_w = font->advance * text_size;
+  int16_t cell_h = font->line_height * text_size;
+  int16_t min_x = x, min_y = y, max_x = x - 1, max_y = y - 1;
+
+  for (; s && *s; s++) {
+    if (*s == '\n') {
+      x = 0;
+      y += cell_h;
+      continue;
+    }
+    if (*s == '\r') continue;
+    if (text_wrap && (x + cell_w > _width)) {
+      x = 0;
+      y += cell_h;
+    }
+    if (x < min_x) min_x = x;
+    if (y < min_y) min_y = y;
+    if (x + cell_w - 1 > max_x) max_x = x + cell_w - 1;
+    if (y + cell_h - 1 > max_y) max_y = y + cell_h - 1;
+    x += cell_w;
+  }
+
+  *x1 = min_x;
+  *y1 = min_y;
+  *w = (max_x >= min_x) ? (max_x - min_x + 1) : 0;
+  *h = (max_y >= min_y) ? (max_y - min_y + 1) : 0;
+}
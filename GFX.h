@@ -26,10 +26,12 @@
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
+#include "GFXFont.h"
 
 class GFX {
 public:
-    GFX(int16_t w, int16_t h) : _width(w), _height(h), rotation(0), WIDTH(w), HEIGHT(h) {}
+    GFX(int16_t w, int16_t h) : _width(w), _height(h), rotation(0), WIDTH(w), HEIGHT(h),
+        cursor_x(0), cursor_y(0), text_color(1), text_bg(1), text_size(1), text_wrap(true), font(&Font5x7) {}
     virtual ~GFX() {}
 
     virtual void drawPixel(int16_t x, int16_t y, uint16_t color) = 0;
@@ -41,16 +43,59 @@ public:
     virtual void drawFastVLine(int16_t x, int16_t y, int16_t h, uint16_t color) {
         for(int16_t i=0; i<h; i++) drawPixel(x, y+i, color);
     }
+    virtual void fillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color) {
+        for(int16_t i=x; i<x+w; i++) drawFastVLine(i, y, h, color);
+    }
+
+    // Shapes, in GFX.cpp. Filled shapes are built from drawFastHLine spans
+    void drawLine(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint16_t color);
+    void drawRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color);
+    void drawCircle(int16_t x0, int16_t y0, int16_t r, uint16_t color);
+    void fillCircle(int16_t x0, int16_t y0, int16_t r, uint16_t color);
+    void drawTriangle(int16_t x0, int16_t y0, int16_t x1, int16_t y1, int16_t x2, int16_t y2, uint16_t color);
+    void fillTriangle(int16_t x0, int16_t y0, int16_t x1, int16_t y1, int16_t x2, int16_t y2, uint16_t color);
+    void drawRoundRect(int16_t x, int16_t y, int16_t w, int16_t h, int16_t r, uint16_t color);
+    void fillRoundRect(int16_t x, int16_t y, int16_t w, int16_t h, int16_t r, uint16_t color);
+
+    // Text, in GFX.cpp. The cursor is the top left corner of the next cell.
+    // bg == color draws transparent glyphs, only the set pixels change.
+    virtual void drawChar(int16_t x, int16_t y, char c, uint16_t color, uint16_t bg, uint8_t size);
+    size_t write(char c);        // Draws at the cursor and advances it, handles \n and wrapping
+    size_t print(const char* s);
+    void   getTextBounds(const char* s, int16_t x, int16_t y, int16_t* x1, int16_t* y1, uint16_t* w, uint16_t* h);
+    void   setCursor(int16_t x, int16_t y) { cursor_x = x; cursor_y = y; }
+    int16_t getCursorX() const { return cursor_x; }
+    int16_t getCursorY() const { return cursor_y; }
+    void   setTextColor(uint16_t c) { text_color = text_bg = c; }
+    void   setTextColor(uint16_t c, uint16_t bg) { text_color = c; text_bg = bg; }
+    void   setTextSize(uint8_t s) { text_size = (s > 0) ? s : 1; }
+    void   setTextWrap(bool w) { text_wrap = w; }
+    void   setFont(const GFXfont* f) { font = f ? f : &Font5x7; }
+    const GFXfont* getFont() const { return font; }
     
     int16_t width() const { return _width; }
     int16_t height() const { return _height; }
     uint8_t getRotation() const { return rotation; }
-    void setRotation(uint8_t r) { rotation = r; }
+    void setRotation(uint8_t r) {
+        rotation = r & 3;
+        // Quarter turns swap the logical width and height
+        _width  = (rotation & 1) ? HEIGHT : WIDTH;
+        _height = (rotation & 1) ? WIDTH  : HEIGHT;
+    }
 
 protected:
+    void drawCircleHelper(int16_t x0, int16_t y0, int16_t r, uint8_t corners, uint16_t color);
+    void fillCircleHelper(int16_t x0, int16_t y0, int16_t r, uint8_t halves, int16_t delta, uint16_t color);
+
     int16_t _width, _height;
     uint8_t rotation;
     const int16_t WIDTH, HEIGHT;
+
+    int16_t cursor_x, cursor_y;
+    uint16_t text_color, text_bg;
+    uint8_t text_size;
+    bool text_wrap;
+    const GFXfont* font;
 };
 
 #endif
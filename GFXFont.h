@@ -0,0 +1,40 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (C) 2025 Lese
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _GFXFONT_H
+#define _GFXFONT_H
+
+#include <cstdint>
+
+// Fixed-width bitmap font. Glyphs are packed 1bpp, row-major and MSB first,
+// each row padded to whole bytes, stored back to back from first to last.
+struct GFXfont {
+    const uint8_t* bitmap;
+    uint8_t first, last;   // Character range
+    uint8_t width, height; // Glyph box in pixels
+    uint8_t advance;       // Pixels from one character to the next
+    uint8_t line_height;   // Pixels from one line to the next
+};
+
+extern const GFXfont Font5x7; // ASCII 0x20-0x7E, 6x8 cells, the default
+
+#endif
@@ -0,0 +1,53 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (C) 2025 Lese
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "RefreshPolicy.h"
+
+// The panel's state is unknown at startup, so the first refresh is full
+RefreshPolicy::RefreshPolicy(int max_partials, int max_minutes) :
+  max_partials(max_partials), max_minutes(max_minutes),
+  partials(0), need_full(true),
+  last_full(std::chrono::steady_clock::now())
+{
+}
+
+bool RefreshPolicy::partialAllowed(void) const {
+  if (need_full) return false;
+  if (max_partials > 0 && partials >= max_partials) return false;
+  if (max_minutes > 0 &&
+      std::chrono::steady_clock::now() - last_full >= std::chrono::minutes(max_minutes)) return false;
+  return true;
+}
+
+void RefreshPolicy::partialDone(void) {
+  partials++;
+}
+
+void RefreshPolicy::fullDone(void) {
+  partials = 0;
+  need_full = false;
+  last_full = std::chrono::steady_clock::now();
+}
+
+void RefreshPolicy::forceFull(void) {
+  need_full = true;
+}
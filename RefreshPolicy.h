@@ -0,0 +1,50 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (C) 2025 Lese
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _REFRESHPOLICY_H
+#define _REFRESHPOLICY_H
+
+#include <chrono>
+
+// Ghosting budget for partial refreshes. Differential updates leave a
+// little residue behind each time, so after max_partials of them or
+// max_minutes since the last full refresh (whichever comes first) the
+// next refresh has to be a full one. 0 disables either limit.
+class RefreshPolicy {
+  public:
+    RefreshPolicy(int max_partials = 5, int max_minutes = 60);
+
+    bool partialAllowed(void) const;  // false once the budget is used up
+    void partialDone(void);
+    void fullDone(void);              // Resets the budget
+    void forceFull(void);             // Next refresh is full, e.g. after a screen change
+    int  partialsSinceFull(void) const { return partials; }
+
+  private:
+    int  max_partials;
+    int  max_minutes;
+    int  partials;
+    bool need_full;
+    std::chrono::steady_clock::time_point last_full;
+};
+
+#endif
@@ -0,0 +1,301 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (C) 2025 Lese
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "SpidevTransport.h"
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <linux/gpio.h>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <thread>
+#include <chrono>
+
+// Helper for delays
+static void delay(int ms) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+SpidevTransport::SpidevTransport(const std::string& spi_device, int dc_gpio, int rst_gpio, int cs_gpio, int busy_gpio,
+                                 const std::string& gpio_chip) :
+  spi_fd(-1),
+  spi_dev_path(spi_device),
+  speed_hz(1000000),
+  bufsiz(4096),
+  dc_gpio(dc_gpio), cs_gpio(cs_gpio), busy_gpio(busy_gpio), rst_gpio(rst_gpio),
+  gpio_chip_path(gpio_chip),
+  dc_fd(-1), cs_fd(-1), busy_fd(-1), rst_fd(-1),
+  busy_edge(false)
+{
+}
+
+SpidevTransport::~SpidevTransport() {
+    if (spi_fd >= 0) close(spi_fd);
+    if (dc_fd >= 0) close(dc_fd);
+    if (cs_fd >= 0) close(cs_fd);
+    if (busy_fd >= 0) close(busy_fd);
+    if (rst_fd >= 0) close(rst_fd);
+}
+
+bool SpidevTransport::begin() {
+    // Setup GPIOs
+    if (!gpio_chip_path.empty()) {
+        // Line requests are ready immediately, no export or udev wait
+        int chip_fd = open(gpio_chip_path.c_str(), O_RDWR);
+        if (chip_fd < 0) {
+            perror("Failed to open GPIO chip");
+            return false;
+        }
+        if (dc_gpio >= 0) dc_fd = gpio_request_line(chip_fd, dc_gpio, GPIO_V2_LINE_FLAG_OUTPUT, 1);
+        if (rst_gpio >= 0) rst_fd = gpio_request_line(chip_fd, rst_gpio, GPIO_V2_LINE_FLAG_OUTPUT, 1);
+        if (cs_gpio >= 0) cs_fd = gpio_request_line(chip_fd, cs_gpio, GPIO_V2_LINE_FLAG_OUTPUT, 1);
+        if (busy_gpio >= 0) {
+            busy_fd = gpio_request_line(chip_fd, busy_gpio,
+                                        GPIO_V2_LINE_FLAG_INPUT | GPIO_V2_LINE_FLAG_EDGE_FALLING, 0);
+            busy_edge = (busy_fd >= 0);
+        }
+        close(chip_fd); // Line handles stay valid on their own
+    } else {
+        if (dc_gpio >= 0) {
+            gpio_export(dc_gpio);
+            gpio_direction_output(dc_gpio, 1);
+            dc_fd = gpio_open_value(dc_gpio, O_WRONLY);
+        }
+
+        if (rst_gpio >= 0) {
+            gpio_export(rst_gpio);
+            gpio_direction_output(rst_gpio, 1);
+            rst_fd = gpio_open_value(rst_gpio, O_WRONLY);
+        }
+
+        if (cs_gpio >= 0) {
+            gpio_export(cs_gpio);
+            gpio_direction_output(cs_gpio, 1);
+            cs_fd = gpio_open_value(cs_gpio, O_WRONLY);
+        }
+
+        if (busy_gpio >= 0) {
+            gpio_export(busy_gpio);
+            gpio_direction_input(busy_gpio);
+            busy_edge = gpio_set_edge(busy_gpio, "falling");
+            busy_fd = gpio_open_value(busy_gpio, O_RDONLY);
+        }
+    }
+
+    if (dc_fd < 0 || rst_fd < 0 || busy_fd < 0) {
+        fprintf(stderr, "Failed to open required GPIOs (DC, RST, BUSY)\n");
+        return false;
+    }
+    // CS is optional if managed by spidev
+    if (cs_gpio >= 0 && cs_fd < 0) {
+         fprintf(stderr, "Failed to open CS GPIO\n");
+         return false;
+    }
+
+    // Setup SPI
+    spi_fd = open(spi_dev_path.c_str(), O_RDWR);
+    if (spi_fd < 0) {
+        perror("Failed to open SPI device");
+        return false;
+    }
+
+    uint8_t mode = SPI_MODE_0;
+    uint8_t bits = 8;
+
+    if (ioctl(spi_fd, SPI_IOC_WR_MODE, &mode) < 0) {
+        perror("SPI mode");
+        return false;
+    }
+    if (ioctl(spi_fd, SPI_IOC_WR_BITS_PER_WORD, &bits) < 0) {
+        perror("SPI bits");
+        return false;
+    }
+    if (!setMaxSpeed(speed_hz)) {
+        return false;
+    }
+
+    // spidev rejects messages above its bufsiz module parameter (4096 unless
+    // raised with spidev.bufsiz=N)
+    FILE* f = fopen("/sys/module/spidev/parameters/bufsiz", "r");
+    if (f) {
+        unsigned long value;
+        if (fscanf(f, "%lu", &value) == 1 && value > 0) bufsiz = value;
+        fclose(f);
+    }
+
+    return true;
+}
+
+// --- GPIO Helpers (Sysfs) ---
+
+void SpidevTransport::gpio_export(int gpio) {
+    char path[64];
+    snprintf(path, sizeof(path), "/sys/class/gpio/gpio%d/direction", gpio);
+    if (access(path, F_OK) == 0) return; // Already exported
+
+    int fd = open("/sys/class/gpio/export", O_WRONLY);
+    if (fd < 0) return;
+    char buf[16];
+    int len = snprintf(buf, sizeof(buf), "%d", gpio);
+    write(fd, buf, len);
+    close(fd);
+    delay(100); // Wait for udev
+}
+
+void SpidevTransport::gpio_direction_output(int gpio, int value) {
+    char path[64];
+    snprintf(path, sizeof(path), "/sys/class/gpio/gpio%d/direction", gpio);
+    int fd = open(path, O_WRONLY);
+    if (fd < 0) return;
+    write(fd, "out", 3);
+    close(fd);
+    
+    // Set initial value
+    int val_fd = gpio_open_value(gpio, O_WRONLY);
+    if (val_fd >= 0) {
+        gpio_set_value(val_fd, value);
+        close(val_fd);
+    }
+}
+
+void SpidevTransport::gpio_direction_input(int gpio) {
+    char path[64];
+    snprintf(path, sizeof(path), "/sys/class/gpio/gpio%d/direction", gpio);
+    int fd = open(path, O_WRONLY);
+    if (fd < 0) return;
+    write(fd, "in", 2);
+    close(fd);
+}
+
+bool SpidevTransport::gpio_set_edge(int gpio, const char* edge) {
+    char path[64];
+    snprintf(path, sizeof(path), "/sys/class/gpio/gpio%d/edge", gpio);
+    int fd = open(path, O_WRONLY);
+    if (fd < 0) return false;
+    bool ok = write(fd, edge, strlen(edge)) == (ssize_t)strlen(edge);
+    close(fd);
+    return ok;
+}
+
+int SpidevTransport::gpio_open_value(int gpio, int flags) {
+    char path[64];
+    snprintf(path, sizeof(path), "/sys/class/gpio/gpio%d/value", gpio);
+    return open(path, flags);
+}
+
+void SpidevTransport::gpio_set_value(int fd, int value) {
+    if (fd < 0) return;
+    if (!gpio_chip_path.empty()) {
+        struct gpio_v2_line_values values;
+        values.bits = value ? 1 : 0;
+        values.mask = 1;
+        ioctl(fd, GPIO_V2_LINE_SET_VALUES_IOCTL, &values);
+        return;
+    }
+    write(fd, value ? "1" : "0", 1);
+}
+
+int SpidevTransport::gpio_get_value(int fd) {
+    if (fd < 0) return 0;
+    if (!gpio_chip_path.empty()) {
+        struct gpio_v2_line_values values;
+        values.bits = 0;
+        values.mask = 1;
+        if (ioctl(fd, GPIO_V2_LINE_GET_VALUES_IOCTL, &values) < 0) return 0;
+        return (values.bits & 1) ? 1 : 0;
+    }
+    char buf[2];
+    lseek(fd, 0, SEEK_SET); // Rewind to read again
+    read(fd, buf, 1);
+    return (buf[0] == '1') ? 1 : 0;
+}
+
+// --- GPIO Helpers (Character device, v2 uAPI) ---
+
+int SpidevTransport::gpio_request_line(int chip_fd, int line, uint64_t flags, int value) {
+    struct gpio_v2_line_request req;
+    memset(&req, 0, sizeof(req));
+    req.offsets[0] = line;
+    req.num_lines = 1;
+    strncpy(req.consumer, "epaper", sizeof(req.consumer) - 1);
+    req.config.flags = flags;
+    if (flags & GPIO_V2_LINE_FLAG_OUTPUT) {
+        req.config.num_attrs = 1;
+        req.config.attrs[0].attr.id = GPIO_V2_LINE_ATTR_ID_OUTPUT_VALUES;
+        req.config.attrs[0].attr.values = value ? 1 : 0;
+        req.config.attrs[0].mask = 1;
+    }
+
+    if (ioctl(chip_fd, GPIO_V2_GET_LINE_IOCTL, &req) < 0) {
+        fprintf(stderr, "Failed to request GPIO line %d: %s\n", line, strerror(errno));
+        return -1;
+    }
+    return req.fd;
+}
+
+int SpidevTransport::waitBusyEdge(int timeout_ms) {
+    if (!busy_edge) return -1;
+    struct pollfd pfd;
+    pfd.fd = busy_fd;
+    pfd.revents = 0;
+    if (!gpio_chip_path.empty()) {
+        pfd.events = POLLIN;
+        int ret = poll(&pfd, 1, timeout_ms);
+        if (ret > 0) {
+            // Drain queued events, only the line level matters
+            struct gpio_v2_line_event events[16];
+            read(busy_fd, events, sizeof(events));
+        }
+        return ret;
+    }
+    // sysfs signals edges as POLLPRI; gpio_get_value() re-arms it on read
+    pfd.events = POLLPRI | POLLERR;
+    return poll(&pfd, 1, timeout_ms);
+}
+
+// --- SPI Helpers ---
+
+bool SpidevTransport::setMaxSpeed(uint32_t hz) {
+    speed_hz = hz;
+    if (spi_fd < 0) return true; // Applied by begin()
+    if (ioctl(spi_fd, SPI_IOC_WR_MAX_SPEED_HZ, &speed_hz) < 0) {
+        perror("SPI speed");
+        return false;
+    }
+    return true;
+}
+
+bool SpidevTransport::transfer(struct spi_ioc_transfer* tr, unsigned n) {
+    if (ioctl(spi_fd, SPI_IOC_MESSAGE(n), tr) < 0) {
+        // Only print error once to avoid flooding logs
+        static bool error_printed = false;
+        if (!error_printed) {
+            perror("SPI transfer failed");
+            fprintf(stderr, "Error code: %d\n", errno);
+            error_printed = true;
+        }
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,76 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (C) 2025 Lese
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _SpidevTransport_H_
+#define _SpidevTransport_H_
+
+#include <string>
+#include "EinkTransport.h"
+
+// spidev for SPI, GPIOs through sysfs or a GPIO character device
+class SpidevTransport : public EinkTransport {
+  public:
+    // With an empty gpio_chip the pins are sysfs GPIO numbers, otherwise they are
+    // line offsets on that character device (e.g. "/dev/gpiochip0").
+    SpidevTransport(const std::string& spi_device, int dc_gpio, int rst_gpio, int cs_gpio, int busy_gpio,
+                    const std::string& gpio_chip = "");
+    ~SpidevTransport();
+
+    bool begin() override;
+    void setReset(int value) override { gpio_set_value(rst_fd, value); }
+    void setDC(int value) override { gpio_set_value(dc_fd, value); }
+    void setCS(int value) override { gpio_set_value(cs_fd, value); }
+    int  getBusy() override { return gpio_get_value(busy_fd); }
+    int  waitBusyEdge(int timeout_ms) override;
+    bool setMaxSpeed(uint32_t hz) override;
+    size_t maxMessageSize() override { return bufsiz; }
+    bool transfer(struct spi_ioc_transfer* tr, unsigned n) override;
+
+  private:
+    // Linux specific members
+    int spi_fd;
+    std::string spi_dev_path;
+    uint32_t speed_hz;
+    size_t bufsiz; // From /sys/module/spidev/parameters/bufsiz
+    int dc_gpio, cs_gpio, busy_gpio, rst_gpio;
+
+    // GPIO character device, empty when using sysfs
+    std::string gpio_chip_path;
+
+    // File descriptors for GPIO values to improve performance
+    // (sysfs value files, or line request handles with gpio_chip)
+    int dc_fd, cs_fd, busy_fd, rst_fd;
+
+    bool busy_edge;      // BUSY reports falling edges, no need to poll
+
+    // GPIO helpers
+    void gpio_export(int gpio);
+    void gpio_direction_output(int gpio, int value);
+    void gpio_direction_input(int gpio);
+    void gpio_set_value(int fd, int value); // Changed to take fd
+    int  gpio_get_value(int fd); // Changed to take fd
+    int  gpio_open_value(int gpio, int flags); // New helper
+    bool gpio_set_edge(int gpio, const char* edge);
+    int  gpio_request_line(int chip_fd, int line, uint64_t flags, int value); // gpio v2 uAPI
+};
+
+#endif // _SpidevTransport_H_
@@ -0,0 +1,359 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (C) 2025 Lese
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "Ssd1683Sim.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+Ssd1683Sim::Ssd1683Sim(int height, int width) :
+  width(width), height(height), temperature(25.0f),
+  max_speed_hz(1000000), reliable_hz(0), bufsiz(4096),
+  dc(1), rst(1), cmd(0), param(0), deep_sleep(false),
+  realtime(false), clock_ms(0), busy_until(0),
+  epoch(std::chrono::steady_clock::now())
+{
+  stride = (width + 7) / 8;
+  plane_size = (size_t)stride * height;
+  ram_bw = (uint8_t*)calloc(plane_size, 1);
+  ram_red = (uint8_t*)calloc(plane_size, 1);
+  panel_bw = (uint8_t*)malloc(plane_size);
+  panel_red = (uint8_t*)calloc(plane_size, 1);
+  memset(panel_bw, 0xFF, plane_size);
+
+  // Waveform durations by Display Update Control 2 value. Sequences
+  // without the display bit (0x04) only load or switch things.
+  for (int i = 0; i < 256; i++) refresh_ms[i] = (i & 0x04) ? 3000 : 5;
+  refresh_ms[0xF7] = 3500; // Vendor "Slow"
+  refresh_ms[0xFF] = 1500; // Vendor "Fast"
+  refresh_ms[0xFC] = 400;  // Partial, display mode 2
+
+  _reset();
+  resetStats();
+}
+
+Ssd1683Sim::~Ssd1683Sim() {
+  free(ram_bw);
+  free(ram_red);
+  free(panel_bw);
+  free(panel_red);
+}
+
+void Ssd1683Sim::resetStats() {
+  memset(&st, 0, sizeof(st));
+}
+
+// Register defaults after hardware or software reset. RAM is retained.
+void Ssd1683Sim::_reset(void) {
+  entry_mode = 0x03;
+  x_start = 0;
+  x_end = stride - 1;
+  y_start = 0;
+  y_end = height - 1;
+  x_cnt = 0;
+  y_cnt = 0;
+  read_sel = 0;
+  update_ctrl1 = 0x00;
+  update_ctrl2 = 0xFF;
+  lut_len = 0;
+  lut_loaded = false; // Registers don't survive a reset
+  gate_v = 0;
+  memset(source_v, 0, sizeof(source_v));
+  vcom_v = 0;
+  eopt = 0;
+  cmd = 0;
+  param = 0;
+  deep_sleep = false;
+}
+
+double Ssd1683Sim::_now(void) const {
+  if (!realtime) return clock_ms;
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+void Ssd1683Sim::_setBusy(int ms) {
+  busy_until = _now() + ms;
+}
+
+void Ssd1683Sim::setReset(int value) {
+  st.gpio_writes++;
+  if (rst == 0 && value == 1) _reset(); // Also the only way out of deep sleep
+  rst = value;
+}
+
+void Ssd1683Sim::setDC(int value) {
+  st.gpio_writes++;
+  dc = value;
+}
+
+int Ssd1683Sim::getBusy() {
+  st.gpio_reads++;
+  return _now() < busy_until ? 1 : 0;
+}
+
+int Ssd1683Sim::waitBusyEdge(int timeout_ms) {
+  st.busy_waits++;
+  double now = _now();
+  double wait = busy_until - now;
+  if (wait <= 0) return 0; // No edge is coming
+  if (timeout_ms >= 0 && timeout_ms < wait) wait = timeout_ms;
+
+  if (realtime) {
+    std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(wait));
+  } else {
+    clock_ms += wait;
+  }
+  st.busy_ms += wait;
+  return _now() >= busy_until ? 1 : 0;
+}
+
+bool Ssd1683Sim::transfer(struct spi_ioc_transfer* tr, unsigned n) {
+  st.spi_messages++;
+
+  size_t total = 0;
+  for (unsigned t = 0; t < n; t++) total += tr[t].len;
+  if (total > bufsiz) {
+    st.rejected++; // EMSGSIZE
+    return false;
+  }
+
+  for (unsigned t = 0; t < n; t++) {
+    const uint8_t* tx = (const uint8_t*)(uintptr_t)tr[t].tx_buf;
+    uint8_t* rx = (uint8_t*)(uintptr_t)tr[t].rx_buf;
+
+    uint32_t hz = tr[t].speed_hz ? tr[t].speed_hz : max_speed_hz;
+    bool garbled = reliable_hz && hz > reliable_hz && dc == 1;
+
+    st.spi_transfers++;
+    st.tx_bytes += tr[t].len;
+    if (rx) st.rx_bytes += tr[t].len;
+    st.spi_ms += tr[t].len * 8000.0 / hz;
+
+    for (uint32_t i = 0; i < tr[t].len; i++) {
+      uint8_t in = tx ? tx[i] : 0;
+      if (garbled && (i % 5) == 0) in ^= 0x01; // Marginal clock, an occasional flipped bit
+      uint8_t out = 0;
+      if (!deep_sleep && rst) {
+        if (dc == 0) {
+          _command(in);
+        } else {
+          out = _data(in);
+        }
+      }
+      if (rx) rx[i] = out;
+    }
+  }
+  return true;
+}
+
+void Ssd1683Sim::_command(uint8_t c) {
+  st.commands++;
+  cmd = c;
+  param = 0;
+
+  switch (cmd) {
+    case 0x12: // Software reset
+      _reset();
+      _setBusy(2);
+      break;
+    case 0x20: { // Master activation
+      if (update_ctrl2 & 0x10) lut_loaded = true; // Waveform from OTP
+      if (!lut_loaded) {
+        // Nothing to drive the panel with
+      } else if ((update_ctrl2 & 0x08) && update_ctrl2 != 0xFF) {
+        // Display mode 2 uses RED RAM as the previous frame and only
+        // drives pixels where it differs from BW RAM. A wrong previous
+        // frame leaves those pixels stale, just like on the glass. The
+        // vendor "Fast" sequence sets the same bit but its waveform
+        // redraws everything, so it stays a full update here.
+        for (size_t i = 0; i < plane_size; i++) {
+          uint8_t diff = ram_bw[i] ^ ram_red[i];
+          panel_bw[i] = (panel_bw[i] & ~diff) | (ram_bw[i] & diff);
+        }
+        memset(panel_red, 0x00, plane_size);
+        st.refreshes++;
+      } else if (update_ctrl2 & 0x04) {
+        memcpy(panel_bw, ram_bw, plane_size);
+        // 0x21 can bypass (0x40) or invert (0x80) RED RAM
+        if (update_ctrl2 == 0xFF || (update_ctrl1 & 0xC0) == 0x40) {
+          memset(panel_red, 0x00, plane_size);
+        } else if ((update_ctrl1 & 0xC0) == 0x80) {
+          for (size_t i = 0; i < plane_size; i++) panel_red[i] = ~ram_red[i];
+        } else {
+          memcpy(panel_red, ram_red, plane_size);
+        }
+        st.refreshes++;
+      }
+      _setBusy(refresh_ms[update_ctrl2]);
+      break;
+    }
+    case 0x32: // Write LUT register
+      lut_len = 0;
+      lut_loaded = true;
+      st.lut_loads++;
+      break;
+  }
+}
+
+uint8_t Ssd1683Sim::_data(uint8_t value) {
+  uint8_t out = 0;
+  size_t idx = (size_t)y_cnt * stride + x_cnt;
+  bool in_ram = (x_cnt < stride && y_cnt < height);
+
+  switch (cmd) {
+    case 0x10: // Deep sleep
+      if (value & 0x03) deep_sleep = true;
+      break;
+    case 0x11: // Data entry mode
+      entry_mode = value & 0x07;
+      break;
+    case 0x21: // Display update control 1
+      if (param == 0) update_ctrl1 = value;
+      break;
+    case 0x22: // Display update control 2
+      update_ctrl2 = value;
+      break;
+    case 0x24: // Write BW RAM
+      if (in_ram) ram_bw[idx] = value;
+      _advance();
+      break;
+    case 0x26: // Write RED RAM
+      if (in_ram) ram_red[idx] = value;
+      _advance();
+      break;
+    case 0x27: // Read RAM, first byte is a dummy
+      if (param > 0) {
+        if (in_ram) out = (read_sel ? ram_red : ram_bw)[idx];
+        _advance();
+      }
+      break;
+    case 0x03: // Gate driving voltage
+      gate_v = value;
+      break;
+    case 0x04: // Source driving voltage, VSH1 VSH2 VSL
+      if (param < 3) source_v[param] = value;
+      break;
+    case 0x1B: { // Read temperature register, 12 bit two's complement in 1/16 C
+      uint16_t raw = (uint16_t)(int16_t)(temperature * 16.0f) & 0xFFF;
+      if (param == 0) out = raw >> 4;
+      if (param == 1) out = (raw & 0x0F) << 4;
+      break;
+    }
+    case 0x2C: // VCOM
+      vcom_v = value;
+      break;
+    case 0x32: // LUT
+      if (lut_len < sizeof(lut_reg)) lut_reg[lut_len++] = value;
+      break;
+    case 0x3F: // End option
+      eopt = value;
+      break;
+    case 0x41: // Read RAM option
+      read_sel = value & 0x01;
+      break;
+    case 0x44: // RAM X start/end
+      if (param == 0) x_start = value & 0x3F;
+      if (param == 1) x_end = value & 0x3F;
+      break;
+    case 0x45: // RAM Y start/end
+      if (param == 0) y_start = (y_start & 0x100) | value;
+      if (param == 1) y_start = (y_start & 0xFF) | ((value & 0x01) << 8);
+      if (param == 2) y_end = (y_end & 0x100) | value;
+      if (param == 3) y_end = (y_end & 0xFF) | ((value & 0x01) << 8);
+      break;
+    case 0x4E: // RAM X counter
+      x_cnt = value & 0x3F;
+      break;
+    case 0x4F: // RAM Y counter
+      if (param == 0) y_cnt = (y_cnt & 0x100) | value;
+      if (param == 1) y_cnt = (y_cnt & 0xFF) | ((value & 0x01) << 8);
+      break;
+    default:
+      break;
+  }
+
+  param++;
+  return out;
+}
+
+// Moves the address counter per data entry mode: ID0 = X increment,
+// ID1 = Y increment, AM = Y first. Wraps inside the RAM window.
+void Ssd1683Sim::_advance(void) {
+  bool x_inc = entry_mode & 0x01;
+  bool y_inc = entry_mode & 0x02;
+  bool y_first = entry_mode & 0x04;
+
+  uint16_t& inner = y_first ? y_cnt : x_cnt;
+  uint16_t& outer = y_first ? x_cnt : y_cnt;
+  uint16_t inner_start = y_first ? y_start : x_start;
+  uint16_t inner_end   = y_first ? y_end : x_end;
+  uint16_t outer_start = y_first ? x_start : y_start;
+  uint16_t outer_end   = y_first ? x_end : y_end;
+  bool inner_inc = y_first ? y_inc : x_inc;
+  bool outer_inc = y_first ? x_inc : y_inc;
+
+  if (inner != inner_end) {
+    inner_inc ? inner++ : inner--;
+    return;
+  }
+  inner = inner_start;
+  if (outer != outer_end) {
+    outer_inc ? outer++ : outer--;
+  } else {
+    outer = outer_start;
+  }
+}
+
+bool Ssd1683Sim::writePbm(const char* path, int plane) const {
+  FILE* f = fopen(path, "wb");
+  if (!f) return false;
+  fprintf(f, "P4\n%d %d\n", width, height);
+  const uint8_t* src = ram(plane);
+  for (size_t i = 0; i < plane_size; i++) {
+    // PBM 1 is black, BW RAM 0 is black
+    fputc(plane == RAM_RED ? src[i] : (uint8_t)~src[i], f);
+  }
+  fclose(f);
+  return true;
+}
+
+bool Ssd1683Sim::writePpm(const char* path) const {
+  FILE* f = fopen(path, "wb");
+  if (!f) return false;
+  fprintf(f, "P6\n%d %d\n255\n", width, height);
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      size_t idx = (size_t)y * stride + x / 8;
+      uint8_t bit = 1 << (7 - x % 8);
+      uint8_t rgb[3] = { 0xFF, 0xFF, 0xFF };
+      if (panel_red[idx] & bit) {
+        rgb[1] = rgb[2] = 0x00;
+      } else if (!(panel_bw[idx] & bit)) {
+        rgb[0] = rgb[1] = rgb[2] = 0x00;
+      }
+      fwrite(rgb, 1, 3, f);
+    }
+  }
+  fclose(f);
+  return true;
+}
@@ -0,0 +1,144 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (C) 2025 Lese
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _Ssd1683Sim_H_
+#define _Ssd1683Sim_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <chrono>
+#include "EinkTransport.h"
+
+// In-process SSD1683 model for running EinkDisplay without hardware.
+// Decodes the command stream into BW/red RAM, models BUSY timing and
+// counts what the same traffic would cost on spidev + GPIO.
+class Ssd1683Sim : public EinkTransport {
+  public:
+    enum {
+      RAM_BW  = 0, // 0x24
+      RAM_RED = 1  // 0x26
+    };
+
+    struct Stats {
+      unsigned long spi_messages;  // SPI_IOC_MESSAGE ioctls
+      unsigned long spi_transfers; // spi_ioc_transfer entries
+      unsigned long gpio_writes;   // DC/RST writes
+      unsigned long gpio_reads;    // BUSY level reads
+      unsigned long busy_waits;    // BUSY edge waits (poll)
+      unsigned long tx_bytes, rx_bytes;
+      unsigned long commands;
+      unsigned long rejected;      // Messages over bufsiz
+      unsigned long refreshes;
+      unsigned long lut_loads;     // 0x32 writes
+      double        busy_ms;       // Simulated time spent with BUSY high
+      double        spi_ms;        // Time on the wire at the requested clocks
+
+      unsigned long syscalls() const { return spi_messages + gpio_writes + gpio_reads + busy_waits; }
+    };
+
+    Ssd1683Sim(int height, int width);
+    ~Ssd1683Sim();
+
+    bool begin() override { return true; }
+    void setReset(int value) override;
+    void setDC(int value) override;
+    void setCS(int value) override {} // Modelled as spidev-managed CS
+    int  getBusy() override;
+    int  waitBusyEdge(int timeout_ms) override;
+    double nowMs() override { return _now(); }
+    bool setMaxSpeed(uint32_t hz) override { max_speed_hz = hz; return true; }
+    size_t maxMessageSize() override { return bufsiz; }
+    bool transfer(struct spi_ioc_transfer* tr, unsigned n) override;
+
+    // By default BUSY periods are skipped and only accounted in stats();
+    // realtime makes waits actually take the modelled time.
+    void setRealtime(bool on) { realtime = on; }
+    void setRefreshTime(uint8_t update_ctrl2, int ms) { refresh_ms[update_ctrl2] = ms; }
+    // Like spidev, messages above bufsiz bytes fail
+    void setBufSize(size_t bytes) { bufsiz = bytes; }
+    // Written data gets corrupted above this clock, 0 = never
+    void setReliableSpeed(uint32_t hz) { reliable_hz = hz; }
+    // What the internal sensor reads, in C
+    void setTemperature(float c) { temperature = c; }
+
+    const Stats& stats() const { return st; }
+    void resetStats();
+
+    const uint8_t* ram(int plane) const { return plane == RAM_RED ? ram_red : ram_bw; }
+    const uint8_t* panelBW() const { return panel_bw; }   // As shown by the last refresh
+    const uint8_t* panelRed() const { return panel_red; }
+    bool sleeping() const { return deep_sleep; }
+    // LUT register and the voltages that go with it, see 0x32
+    const uint8_t* lut() const { return lut_reg; }
+    size_t  lutLength() const { return lut_len; }
+    uint8_t gateVoltage() const { return gate_v; }
+    const uint8_t* sourceVoltage() const { return source_v; }
+    uint8_t vcom() const { return vcom_v; }
+
+    bool writePbm(const char* path, int plane) const; // RAM plane, black = BW 0 / red 1
+    bool writePpm(const char* path) const;            // Panel image in colour
+
+  private:
+    void _reset(void);
+    void _command(uint8_t cmd);
+    uint8_t _data(uint8_t value);
+    void _advance(void);
+    void _setBusy(int ms);
+    double _now(void) const;
+
+    int width, height;
+    uint16_t stride;
+    size_t plane_size;
+    uint8_t *ram_bw, *ram_red, *panel_bw, *panel_red;
+
+    // Registers
+    uint8_t  entry_mode;
+    uint16_t x_start, x_end, y_start, y_end;
+    uint16_t x_cnt, y_cnt;
+    uint8_t  read_sel;
+    uint8_t  update_ctrl1, update_ctrl2;
+    uint8_t  lut_reg[256];
+    size_t   lut_len;
+    bool     lut_loaded;   // From OTP or 0x32, a refresh without one shows nothing
+    uint8_t  gate_v, source_v[3], vcom_v, eopt;
+    float    temperature;
+
+    uint32_t max_speed_hz, reliable_hz;
+    size_t   bufsiz;
+
+    // Command decoder
+    int     dc, rst;
+    uint8_t cmd;
+    int     param;
+    bool    deep_sleep;
+
+    // BUSY model, times in ms
+    bool   realtime;
+    int    refresh_ms[256];
+    double clock_ms;   // Virtual clock when not realtime
+    double busy_until;
+    std::chrono::steady_clock::time_point epoch;
+
+    Stats st;
+};
+
+#endif // _Ssd1683Sim_H_
@@ -24,7 +24,13 @@
 #include <string>
 #include <unistd.h>
 #include <vector>
+#include <memory>
+#include <chrono>
+#include <functional>
 #include "EinkDisplay.h"
+#include "Ssd1683Sim.h"
+#include "Dither.h"
+#include "BitPack.h"
 #include "image_data.h"
 
 // Default GPIOs (Change these or pass as arguments)
@@ -36,23 +42,149 @@
 #define DEFAULT_CS_PIN   -1  // -1 means let spidev handle CS
 #define DEFAULT_BUSY_PIN (DEFAULT_BASE_PIN + 39)
 
+// Prints what the simulated controller saw since the last call
+static void print_sim_stats(Ssd1683Sim* sim, const char* op) {
+    if (!sim) return;
+    const Ssd1683Sim::Stats& st = sim->stats();
+    printf("  [sim] %-10s syscalls %5lu (spi %lu, gpio w %lu r %lu, poll %lu), tx %6lu bytes (%.1f ms), busy %.0f ms\n",
+           op, st.syscalls(), st.spi_messages, st.gpio_writes, st.gpio_reads, st.busy_waits,
+           st.tx_bytes, st.spi_ms, st.busy_ms);
+    sim->resetStats();
+}
+
+// Times one drawing call, repeated until it has run for a while
+static void bench(const char* name, const std::function<void()>& fn) {
+    typedef std::chrono::steady_clock clock;
+    long iterations = 0;
+    clock::time_point start = clock::now();
+    double elapsed_us = 0;
+    do {
+        for (int i = 0; i < 100; i++) fn();
+        iterations += 100;
+        elapsed_us = std::chrono::duration<double, std::micro>(clock::now() - start).count();
+    } while (elapsed_us < 200000);
+    printf("  %-28s %10.3f us/call\n", name, elapsed_us / iterations);
+}
+
+// Framebuffer-only micro-benchmarks at 400x300, against the simulator
+static int run_bench(void) {
+    Ssd1683Sim sim(300, 400);
+    EinkDisplay display(300, 400, sim);
+    if (!display.begin()) return 1;
+
+    printf("Drawing primitives (400x300 framebuffer):\n");
+    bench("drawPixel",                 [&]() { display.drawPixel(200, 150, BLACK); });
+    bench("drawFastHLine 400",         [&]() { display.drawFastHLine(0, 150, 400, BLACK); });
+    bench("drawFastVLine 300",         [&]() { display.drawFastVLine(200, 0, 300, BLACK); });
+    bench("drawLine diagonal",         [&]() { display.drawLine(0, 0, 399, 299, BLACK); });
+    bench("drawLine shallow",          [&]() { display.drawLine(0, 100, 399, 140, BLACK); });
+    bench("drawRect 400x300",          [&]() { display.drawRect(0, 0, 400, 300, BLACK); });
+    bench("fillRect 400x300",          [&]() { display.fillRect(0, 0, 400, 300, RED); });
+    bench("fillRect 37x211",           [&]() { display.fillRect(13, 40, 37, 211, BLACK); });
+    bench("drawCircle r=140",          [&]() { display.drawCircle(200, 150, 140, BLACK); });
+    bench("fillCircle r=140",          [&]() { display.fillCircle(200, 150, 140, BLACK); });
+    bench("drawTriangle",              [&]() { display.drawTriangle(10, 290, 200, 5, 390, 250, BLACK); });
+    bench("fillTriangle",              [&]() { display.fillTriangle(10, 290, 200, 5, 390, 250, BLACK); });
+    bench("drawRoundRect r=30",        [&]() { display.drawRoundRect(10, 10, 380, 280, 30, BLACK); });
+    bench("fillRoundRect r=30",        [&]() { display.fillRoundRect(10, 10, 380, 280, 30, BLACK); });
+
+    printf("Bitmaps:\n");
+    bench("drawBitmap 400x300 copy",   [&]() { display.drawBitmap(0, 0, 400, 300, gImage_bw_boy, EinkDisplay::PLANE_BW); });
+    bench("drawBitmap 400x300 x=3",    [&]() { display.drawBitmap(3, 0, 400, 300, gImage_bw_boy, EinkDisplay::PLANE_BW, EinkDisplay::ROP_AND); });
+    bench("drawBitmap 64x64 x=13 xor", [&]() { display.drawBitmap(13, 20, 64, 64, gImage_bw_boy, EinkDisplay::PLANE_RED, EinkDisplay::ROP_XOR); });
+
+    printf("Frame diffing:\n");
+    display.displayImage(gImage_bw_boy, gImage_red);
+    bench("displayImage unchanged",    [&]() { display.displayImage(gImage_bw_boy, gImage_red); });
+
+    printf("Text (5x7 font):\n");
+    bench("drawChar aligned",          [&]() { display.drawChar(8, 8, 'A', BLACK, BLACK, 1); });
+    bench("drawChar unaligned",        [&]() { display.drawChar(11, 8, 'A', BLACK, BLACK, 1); });
+    bench("drawChar opaque",           [&]() { display.drawChar(11, 8, 'A', BLACK, WHITE, 1); });
+    bench("drawChar size 3",           [&]() { display.drawChar(11, 8, 'A', BLACK, BLACK, 3); });
+    bench("print full screen",         [&]() {
+        display.setCursor(0, 0);
+        display.setTextColor(BLACK, WHITE);
+        for (int line = 0; line < 37; line++) display.print("0123456789 The quick brown fox jumps over\n");
+    });
+
+    // Horizontal ramp with a vertical ramp disc, a stand-in for a photo
+    std::vector<uint8_t> gray(400 * 300);
+    for (int y = 0; y < 300; y++) {
+        for (int x = 0; x < 400; x++) {
+            int dx = x - 300, dy = y - 150;
+            gray[y * 400 + x] = (dx * dx + dy * dy < 80 * 80) ? (y * 255 / 299) : (x * 255 / 399);
+        }
+    }
+    std::vector<uint8_t> plane(50 * 300);
+
+    printf("Dithering (400x300 grayscale to BW plane):\n");
+    bench("threshold",                 [&]() { ditherGray(gray.data(), 400, 300, 400, plane.data(), DITHER_THRESHOLD); });
+    bench("bayer 2x2",                 [&]() { ditherGray(gray.data(), 400, 300, 400, plane.data(), DITHER_BAYER2); });
+    bench("bayer 4x4",                 [&]() { ditherGray(gray.data(), 400, 300, 400, plane.data(), DITHER_BAYER4); });
+    bench("bayer 8x8",                 [&]() { ditherGray(gray.data(), 400, 300, 400, plane.data(), DITHER_BAYER8); });
+    bench("floyd-steinberg",           [&]() { ditherGray(gray.data(), 400, 300, 400, plane.data(), DITHER_FLOYD_STEINBERG); });
+    bench("atkinson",                  [&]() { ditherGray(gray.data(), 400, 300, 400, plane.data(), DITHER_ATKINSON); });
+
+    // Same picture in colour: red ramp left to right, fading to gray downwards
+    std::vector<uint8_t> rgb(400 * 300 * 3);
+    for (int i = 0; i < 400 * 300; i++) {
+        uint8_t g = gray[i];
+        rgb[i * 3 + 0] = g;
+        rgb[i * 3 + 1] = g * (i / 400) / 299;
+        rgb[i * 3 + 2] = g * (i / 400) / 299;
+    }
+    std::vector<uint8_t> plane_red(50 * 300);
+
+    printf("Tri-colour (400x300 RGB888 to both planes):\n");
+    bench("nearest colour",            [&]() { ditherTricolor(rgb.data(), 400, 300, 400 * 3, 3, plane.data(), plane_red.data(), false); });
+    bench("error diffusion",           [&]() { ditherTricolor(rgb.data(), 400, 300, 400 * 3, 3, plane.data(), plane_red.data(), true); });
+
+    // A full frame of 0x00/0xFF mask bytes, e.g. from a compare
+    std::vector<uint8_t> mask(400 * 300);
+    for (size_t i = 0; i < mask.size(); i++) mask[i] = (gray[i] > 127) ? 0xFF : 0x00;
+    std::string simd_pack = std::string("packBits ") + bitPackImpl();
+    std::string simd_unpack = std::string("unpackBits ") + bitPackImpl();
+
+    printf("Bit packing (400x300 8bpp mask <-> 1bpp plane):\n");
+    bench("packBits scalar",           [&]() { packBitsScalar(mask.data(), 400 * 300, plane.data(), true); });
+    bench(simd_pack.c_str(),           [&]() { packBits(mask.data(), 400 * 300, plane.data(), true); });
+    bench("unpackBits scalar",         [&]() { unpackBitsScalar(plane.data(), 400 * 300, mask.data(), true); });
+    bench(simd_unpack.c_str(),         [&]() { unpackBits(plane.data(), 400 * 300, mask.data(), true); });
+    return 0;
+}
+
 int main(int argc, char* argv[]) {
     std::string spi_dev = DEFAULT_SPI_DEV;
     std::string arg_image;
+    std::string gpio_chip; // Empty: sysfs GPIO numbers
     int dc = DEFAULT_DC_PIN;
     int rst = DEFAULT_RST_PIN;
     int cs = DEFAULT_CS_PIN;
     int busy = DEFAULT_BUSY_PIN;
     int image_id = 0;
 
-    // Parse args: ./epaper_test [arg_image] [dc] [rst] [cs] [busy]
-    
+    // Parse args: ./epaper_test [--sim] [arg_image] [dc] [rst] [cs] [busy] [gpiochip]
+    // With gpiochip (e.g. /dev/gpiochip0) the pins are line offsets on that chip
+    // With --sim no hardware is touched, the result is written to epaper_sim.ppm
+    // ./epaper_test --bench times the drawing code and exits
+
+    if (argc > 1 && std::string(argv[1]) == "--bench") {
+        return run_bench();
+    }
+
     int arg_idx = 1;
+    bool use_sim = false;
+    if (argc > arg_idx && std::string(argv[arg_idx]) == "--sim") {
+        use_sim = true;
+        arg_idx++;
+    }
     if (argc > arg_idx) arg_image = argv[arg_idx++];
     if (argc > arg_idx) dc = std::stoi(argv[arg_idx++]);
     if (argc > arg_idx) rst = std::stoi(argv[arg_idx++]);
     if (argc > arg_idx) cs = std::stoi(argv[arg_idx++]);
     if (argc > arg_idx) busy = std::stoi(argv[arg_idx++]);
+    if (argc > arg_idx) gpio_chip = argv[arg_idx++];
 
     if (arg_image == "boy") {
         image_id = 0;
@@ -69,15 +201,23 @@ int main(int argc, char* argv[]) {
     } else if (arg_image == "eagle_atkinson") {
         image_id = 6;
     } else {
-        printf("Usage: %s [boy girl beaglebone tower eagle_binary eagle_bayer eagle_atkinson]\n", argv[0]);
+        printf("Usage: %s [--bench | [--sim] [boy girl beaglebone tower eagle_binary eagle_bayer eagle_atkinson]]\n", argv[0]);
         return 0;
     }
 
     std::cout << "Initializing E-Ink Display..." << std::endl;
-    std::cout << "SPI: " << spi_dev << std::endl;
+    std::cout << "SPI: " << (use_sim ? "simulated SSD1683" : spi_dev) << std::endl;
     
     // Initialize display for HINK-E042A162 (4.2 inch, 400x300)
-    EinkDisplay display(300, 400, spi_dev, dc, rst, cs, busy);
+    std::unique_ptr<Ssd1683Sim> sim;
+    std::unique_ptr<EinkDisplay> display_ptr;
+    if (use_sim) {
+        sim.reset(new Ssd1683Sim(300, 400));
+        display_ptr.reset(new EinkDisplay(300, 400, *sim));
+    } else {
+        display_ptr.reset(new EinkDisplay(300, 400, spi_dev, dc, rst, cs, busy, gpio_chip));
+    }
+    EinkDisplay& display = *display_ptr;
 
     if (!display.begin()) {
         std::cerr << "Failed to initialize display!" << std::endl;
@@ -86,15 +226,18 @@ int main(int argc, char* argv[]) {
 
     std::cout << "Preparing display (Init & Power On)..." << std::endl;
     display.prepare();
+    display.setSleepTimeout(2000); // Stay awake between the clear and the image
+    std::cout << "Temperature: " << display.readTemperature() << " C" << std::endl;
+    print_sim_stats(sim.get(), "prepare");
 
     // --- Added Clear Cycle to remove ghosting/artifacts ---
     std::cout << "Clearing display (White refresh)..." << std::endl;
     display.clearDisplay();
+    print_sim_stats(sim.get(), "clear");
     display.displayNormal(); // Use Normal/Slow for clear
-    
-    // Display goes to sleep after display(), so we must wake it up again
-    std::cout << "Re-initializing for Normal Mode Image..." << std::endl;
-    display.prepare();
+    print_sim_stats(sim.get(), "refresh");
+    // The controller is still awake, so no reset and init before the image.
+    // It goes to deep sleep after 2 s idle or when display is destroyed.
     // -----------------------------------------------------
 
     std::cout << "Displaying image (Normal/Slow Mode)..." << std::endl;
@@ -128,9 +271,18 @@ int main(int argc, char* argv[]) {
 
     // Pass NULL for red channel to avoid displaying old/garbage data
     // display.displayImage(gImage_bw_beaglebone, NULL);
+    print_sim_stats(sim.get(), "image");
     
     std::cout << "Updating display (Normal)..." << std::endl;
     display.displayNormal();
+    std::cout << "Refresh took " << display.lastRefreshTime() << " ms" << std::endl;
+    print_sim_stats(sim.get(), "refresh");
+
+    if (sim) {
+        sim->writePpm("epaper_sim.ppm");
+        std::cout << "Panel image written to epaper_sim.ppm" << std::endl;
+        return 0;
+    }
     
     std::cout << "Waiting 1 seconds..." << std::endl;
     sleep(1);
@@ -0,0 +1,381 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (C) 2025 Lese
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+// Off-target regression checks: drives EinkDisplay against Ssd1683Sim
+// and compares controller RAM and the simulated panel with what the
+// frame should be. Run with "make check", exits non-zero on a failure.
+
+#include <iostream>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include "EinkDisplay.h"
+#include "Ssd1683Sim.h"
+#include "BitPack.h"
+#include "Dither.h"
+#include "image_data.h"
+
+#define PANEL_W     400
+#define PANEL_H     300
+#define PLANE_SIZE  (PANEL_W / 8 * PANEL_H)
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        std::cerr << "  FAIL " << __FILE__ << ":" << __LINE__ << ": " #cond << std::endl; \
+        failures++; \
+    } \
+  } while (0)
+
+// Simulator with short BUSY periods so the checks run quickly
+static void fast_sim(Ssd1683Sim& sim) {
+  for (int i = 0; i < 256; i++) sim.setRefreshTime(i, (i & 0x04) ? 10 : 1);
+}
+
+static bool same(const uint8_t* a, const uint8_t* b) {
+  return memcmp(a, b, PLANE_SIZE) == 0;
+}
+
+// Random drawing flushed through the shadow diff must leave RAM exactly
+// like a display without begin(), which has no shadow and uploads whole rects
+static void check_flush_diff(void) {
+  std::cout << "flush diffing vs framebuffer" << std::endl;
+  Ssd1683Sim sim(PANEL_H, PANEL_W), ref_sim(PANEL_H, PANEL_W);
+  EinkDisplay display(PANEL_H, PANEL_W, sim), ref(PANEL_H, PANEL_W, ref_sim);
+  CHECK(display.begin());
+  display.prepare();
+  ref.prepare();
+
+  srand(1);
+  unsigned long diffed_bytes = 0, ref_bytes = 0;
+  for (int round = 0; round < 30; round++) {
+    uint8_t rot = round % 4;
+    display.setRotation(rot);
+    ref.setRotation(rot);
+    for (int i = 0; i < 10; i++) {
+      int x = rand() % PANEL_W, y = rand() % PANEL_H;
+      int w = rand() % 80, h = rand() % 40, c = rand() % 3;
+      display.fillRect(x, y, w, h, c);
+      ref.fillRect(x, y, w, h, c);
+    }
+    int lx = rand() % PANEL_W, ly = rand() % PANEL_H;
+    display.drawLine(0, 0, lx, ly, BLACK);
+    ref.drawLine(0, 0, lx, ly, BLACK);
+    display.setCursor(10, 10);
+    ref.setCursor(10, 10);
+    display.print("12:34");
+    ref.print("12:34");
+
+    sim.resetStats();
+    ref_sim.resetStats();
+    display.flush();
+    ref.flush();
+    diffed_bytes += sim.stats().tx_bytes;
+    ref_bytes += ref_sim.stats().tx_bytes;
+    CHECK(same(sim.ram(Ssd1683Sim::RAM_BW), ref_sim.ram(Ssd1683Sim::RAM_BW)));
+    CHECK(same(sim.ram(Ssd1683Sim::RAM_RED), ref_sim.ram(Ssd1683Sim::RAM_RED)));
+  }
+  CHECK(diffed_bytes < ref_bytes);
+
+  // Nothing changed, nothing sent
+  sim.resetStats();
+  CHECK(!display.flush());
+  CHECK(sim.stats().tx_bytes == 0);
+}
+
+// Image bytes land in RAM unchanged, and pixel (0,0) is the MSB of the
+// first byte at rotation 0 and the LSB of the last byte at rotation 2
+static void check_orientation(void) {
+  std::cout << "displayImage orientation" << std::endl;
+  Ssd1683Sim sim(PANEL_H, PANEL_W);
+  fast_sim(sim);
+  EinkDisplay display(PANEL_H, PANEL_W, sim);
+  CHECK(display.begin());
+  display.prepare();
+
+  CHECK(display.displayImage(gImage_bw_boy, gImage_red));
+  CHECK(same(sim.ram(Ssd1683Sim::RAM_BW), gImage_bw_boy));
+  CHECK(same(sim.ram(Ssd1683Sim::RAM_RED), gImage_red));
+  CHECK(!display.displayImage(gImage_bw_boy, gImage_red));
+  CHECK(display.displayFast());
+  CHECK(same(sim.panelBW(), gImage_bw_boy));
+  CHECK(display.lastRefreshTime() == 10);
+
+  display.fillRect(0, 0, display.width(), display.height(), WHITE);
+  display.drawPixel(0, 0, BLACK);
+  display.flush();
+  CHECK(sim.ram(Ssd1683Sim::RAM_BW)[0] == 0x7F);
+
+  display.setRotation(2);
+  display.fillRect(0, 0, display.width(), display.height(), WHITE);
+  display.drawPixel(0, 0, BLACK);
+  display.flush();
+  CHECK(sim.ram(Ssd1683Sim::RAM_BW)[0] == 0xFF);
+  CHECK(sim.ram(Ssd1683Sim::RAM_BW)[PLANE_SIZE - 1] == 0xFE);
+}
+
+// Partial refreshes only flip what changed, so a wrong previous frame in
+// red RAM would leave stale pixels on the simulated panel
+static void check_partial(void) {
+  std::cout << "partial vs full refresh" << std::endl;
+  Ssd1683Sim sim(PANEL_H, PANEL_W);
+  fast_sim(sim);
+  EinkDisplay display(PANEL_H, PANEL_W, sim);
+  CHECK(display.begin());
+  display.prepare();
+  RefreshPolicy policy(3, 0);
+  display.setRefreshPolicy(&policy);
+
+  // Nothing known on the glass yet, so the first one is full
+  display.fillRect(20, 20, 100, 50, BLACK);
+  display.flush();
+  display.displayPartial();
+  CHECK(display.lastRefreshMode() == EinkDisplay::MODE_NORMAL);
+
+  std::vector<EinkDisplay::RefreshMode> modes;
+  for (int i = 0; i < 8; i++) {
+    display.fillRect(200, 200, 120, 20, WHITE);
+    display.setCursor(200, 200);
+    display.setTextColor(BLACK);
+    display.setTextSize(2);
+    display.print(i & 1 ? "12:01" : "12:02");
+    display.fillRect(i * 40, 100, 30, 30, (i & 2) ? BLACK : WHITE);
+    display.flush();
+    display.displayPartial();
+    modes.push_back(display.lastRefreshMode());
+    CHECK(same(sim.panelBW(), sim.ram(Ssd1683Sim::RAM_BW)));
+  }
+  // Policy allows 3 partials, then forces a full refresh
+  CHECK(modes[0] == EinkDisplay::MODE_PARTIAL && modes[2] == EinkDisplay::MODE_PARTIAL);
+  CHECK(modes[3] == EinkDisplay::MODE_NORMAL);
+  CHECK(modes[4] == EinkDisplay::MODE_PARTIAL);
+
+  // Red RAM lent to a partial refresh comes back with the next full one
+  display.setRefreshPolicy(NULL);
+  display.displayImage(gImage_bw_girl, gImage_red);
+  display.displayNormal();
+  display.displayPartial();
+  CHECK(display.lastRefreshMode() == EinkDisplay::MODE_PARTIAL);
+  display.displayNormal();
+  CHECK(same(sim.ram(Ssd1683Sim::RAM_RED), gImage_red));
+
+  // MODE_AUTO doesn't go partial while red RAM holds red
+  sim.setTemperature(25);
+  CHECK(display.readTemperature() == 25.0f);
+  display.displayAsync(EinkDisplay::MODE_AUTO).get();
+  CHECK(display.lastRefreshMode() == EinkDisplay::MODE_FAST);
+  CHECK(same(sim.ram(Ssd1683Sim::RAM_RED), gImage_red));
+}
+
+// Red drawn while a partial refresh borrows red RAM still counts as a
+// change, and the next full refresh shows it
+static void check_red_while_borrowed(void) {
+  std::cout << "red changes during a partial" << std::endl;
+  Ssd1683Sim sim(PANEL_H, PANEL_W);
+  fast_sim(sim);
+  EinkDisplay display(PANEL_H, PANEL_W, sim);
+  CHECK(display.begin());
+  display.prepare();
+  display.setSleepTimeout(-1);
+
+  // The OTP fast sequence (0xFF) runs display mode 2, which doesn't show
+  // red. A custom fast waveform refreshes with 0xC7, which does.
+  static uint8_t lut[227];
+  memset(lut, 0x55, sizeof(lut));
+  EinkDisplay::Waveform band = { -40, lut, sizeof(lut), 0x17, { 0x41, 0xA8, 0x32 }, 0x30, 0x22 };
+  display.setWaveforms(EinkDisplay::MODE_FAST, &band, 1);
+  sim.setTemperature(25);
+  display.readTemperature();
+
+  display.fillRect(0, 0, 50, 50, BLACK);
+  display.flush();
+  display.displayNormal();
+  display.fillRect(0, 0, 50, 50, WHITE);
+  display.flush();
+  display.displayPartial();
+  CHECK(display.lastRefreshMode() == EinkDisplay::MODE_PARTIAL);
+
+  // Red only, through flush()
+  display.fillRect(104, 100, 16, 8, RED);
+  CHECK(display.flush());
+  display.displayPartial(); // Borrowed again, red still owed
+  display.displayAsync(EinkDisplay::MODE_AUTO).get();
+  CHECK(display.lastRefreshMode() == EinkDisplay::MODE_FAST);
+  CHECK(sim.panelRed()[100 * PANEL_W / 8 + 104 / 8] == 0xFF);
+
+  // Red only, through the worker
+  display.fillRect(0, 0, 8, 8, BLACK);
+  display.flush();
+  display.displayPartial();
+  CHECK(display.lastRefreshMode() == EinkDisplay::MODE_PARTIAL);
+  CHECK(display.startWorker(EinkDisplay::MODE_AUTO));
+  unsigned long refreshes = sim.stats().refreshes;
+  display.fillRect(200, 200, 16, 8, RED);
+  display.present();
+  display.stopWorker();
+  CHECK(sim.stats().refreshes == refreshes + 1);
+  CHECK(display.lastRefreshMode() == EinkDisplay::MODE_FAST);
+  CHECK(sim.panelRed()[200 * PANEL_W / 8 + 200 / 8] == 0xFF);
+  CHECK(sim.panelRed()[100 * PANEL_W / 8 + 104 / 8] == 0xFF);
+}
+
+// The probe never goes above its cap and keeps the old clock when no
+// rate verifies
+static void check_spi_probe(void) {
+  std::cout << "SPI clock probe" << std::endl;
+  Ssd1683Sim sim(PANEL_H, PANEL_W);
+  fast_sim(sim);
+  EinkDisplay display(PANEL_H, PANEL_W, sim);
+  CHECK(display.begin());
+  display.prepare();
+
+  sim.setReliableSpeed(12000000);
+  CHECK(display.probeSpiSpeed() == 12000000);
+  CHECK(display.probeSpiSpeed(11000000) == 11000000);
+  CHECK(display.probeSpiSpeed(500000) == 500000);
+
+  // Nothing reads back intact
+  display.setSpiSpeed(DEFAULT_SPI_SPEED_HZ);
+  sim.setReliableSpeed(100000);
+  CHECK(display.probeSpiSpeed() == DEFAULT_SPI_SPEED_HZ);
+  CHECK(display.probeSpiSpeed(2000000) == 2000000);
+
+  // The pattern went to BW RAM, the next flush puts the frame back
+  sim.setReliableSpeed(0);
+  display.flush();
+  CHECK(sim.ram(Ssd1683Sim::RAM_BW)[0] == 0xFF);
+}
+
+// A band's LUT is sent once, and again only when the band changes or an
+// OTP refresh replaced it
+static void check_lut_cache(void) {
+  std::cout << "LUT reload on band change" << std::endl;
+  Ssd1683Sim sim(PANEL_H, PANEL_W);
+  fast_sim(sim);
+  EinkDisplay display(PANEL_H, PANEL_W, sim);
+  CHECK(display.begin());
+  display.prepare();
+  display.setSleepTimeout(-1); // Sleep would lose the LUT
+
+  static uint8_t cold_lut[227], warm_lut[227];
+  memset(cold_lut, 0xAA, sizeof(cold_lut));
+  memset(warm_lut, 0xBB, sizeof(warm_lut));
+  EinkDisplay::Waveform bands[2] = {
+    { -10, cold_lut, sizeof(cold_lut), 0x17, { 0x41, 0xA8, 0x32 }, 0x30, 0x22 },
+    {  15, warm_lut, sizeof(warm_lut), 0x17, { 0x41, 0xB0, 0x32 }, 0x28, 0x22 },
+  };
+  display.setWaveforms(EinkDisplay::MODE_FAST, bands, 2);
+
+  sim.setTemperature(20);
+  display.readTemperature();
+  display.displayFast();
+  CHECK(sim.stats().lut_loads == 1);
+  CHECK(sim.lutLength() == sizeof(warm_lut) && sim.lut()[0] == 0xBB && sim.vcom() == 0x28);
+  display.displayFast();
+  CHECK(sim.stats().lut_loads == 1);
+
+  sim.setTemperature(5);
+  display.readTemperature();
+  display.displayFast();
+  CHECK(sim.stats().lut_loads == 2);
+  CHECK(sim.lut()[0] == 0xAA && sim.vcom() == 0x30);
+
+  display.displayNormal(); // OTP waveform overwrites the LUT register
+  display.displayFast();
+  CHECK(sim.stats().lut_loads == 3);
+}
+
+// The NEON/SSE2 packers must match the scalar reference bit for bit,
+// including the padded last byte and not writing past it. Runs on
+// whichever backend this build picked.
+static void check_bitpack(void) {
+  std::cout << "bit packing, " << bitPackImpl() << " vs scalar" << std::endl;
+  enum { MAX_N = 200, GUARD = 16 };
+  uint8_t src[MAX_N + 1], bits[MAX_N / 8 + 1];
+  uint8_t got[MAX_N + GUARD], want[MAX_N + GUARD];
+
+  srand(3);
+  for (int i = 0; i <= MAX_N; i++) src[i] = rand();
+  for (int i = 0; i <= MAX_N / 8; i++) bits[i] = rand();
+
+  for (int inv = 0; inv < 2; inv++) {
+    for (int n = 1; n <= MAX_N; n++) {
+      // Unaligned source as well, the SIMD loads must not care
+      for (int off = 0; off < 2; off++) {
+        if (n + off > MAX_N + 1) continue;
+        memset(got, 0xA5, sizeof(got));
+        memset(want, 0xA5, sizeof(want));
+        packBits(src + off, n, got, inv);
+        packBitsScalar(src + off, n, want, inv);
+        CHECK(memcmp(got, want, sizeof(got)) == 0);
+      }
+
+      memset(got, 0xA5, sizeof(got));
+      memset(want, 0xA5, sizeof(want));
+      unpackBits(bits, n, got, inv);
+      unpackBitsScalar(bits, n, want, inv);
+      CHECK(memcmp(got, want, sizeof(got)) == 0);
+    }
+  }
+}
+
+static void check_dither(void) {
+  std::cout << "ordered dithering, " << ditherImpl() << " vs scalar" << std::endl;
+  enum { MAX_W = 200, ROWS = 9, STRIDE = MAX_W + 3, OUT_STRIDE = (MAX_W + 7) / 8, GUARD = 16 };
+  static const DitherMethod methods[] = { DITHER_THRESHOLD, DITHER_BAYER2, DITHER_BAYER4,
+                                          DITHER_BAYER8 };
+  std::vector<uint8_t> gray(STRIDE * ROWS);
+  std::vector<uint8_t> got(OUT_STRIDE * ROWS + GUARD), want(OUT_STRIDE * ROWS + GUARD);
+
+  srand(4);
+  for (size_t i = 0; i < gray.size(); i++) gray[i] = rand();
+
+  for (size_t m = 0; m < sizeof(methods) / sizeof(methods[0]); m++) {
+    for (int w = 1; w <= MAX_W; w++) {
+      // Odd stride so most rows start unaligned
+      memset(&got[0], 0xA5, got.size());
+      memset(&want[0], 0xA5, want.size());
+      CHECK(ditherGray(&gray[0], w, ROWS, STRIDE, &got[0], methods[m], 100));
+      CHECK(ditherGrayScalar(&gray[0], w, ROWS, STRIDE, &want[0], methods[m], 100));
+      CHECK(got == want);
+    }
+  }
+}
+
+int main() {
+  check_flush_diff();
+  check_orientation();
+  check_partial();
+  check_red_while_borrowed();
+  check_spi_probe();
+  check_lut_cache();
+  check_bitpack();
+  check_dither();
+
+  if (failures) {
+    std::cerr << failures << " check(s) failed" << std::endl;
+    return 1;
+  }
+  std::cout << "All checks passed" << std::endl;
+  return 0;
+}